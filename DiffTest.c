@@ -0,0 +1,1051 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+
+// Differential test of the simulator engines.
+//   DiffTest [-i inputsdir] [-n cases] [-s seed] [-o reprofile] [-T tracetool] simulator
+// Replays every inputs/*/input_public.txt with every engine configuration against output_public.txt, then
+// generates random small machines and tapes and compares every engine configuration with a plain recursive
+// simulation of the reference semantics. Long machines, with far more max moves, are compared the same way
+// with the configurations whose code only long runs reach. A disagreement is minimized and printed as a
+// machine in the standard input format (also written to reprofile, if given). Random machines are then run in
+// batches, as many machines per simulator run, and a spill file is made to fail. Every trace is read back with
+// tracetool, if given, whose verdicts must be the simulator ones. Exits with 1 if any engine disagrees
+
+#define MAXSTATES 8
+#define MAXRULES 24
+#define WIDEPADDING 72              // Unreachable states of wide machines, ahead of the reachable ones on the state sets
+#define MAXACCEPT 4
+#define MAXTAPES 6
+#define MAXTAPELENGTH 12
+#define MAXMOVES 12
+#define LONGMAXMOVES 20000          // Max moves of long machines: heads of their walks go past a huge page of tape cells
+#define LONGSHARE 4                 // One case in LONGSHARE is also run as a long machine
+#define REFERENCEBUDGET 2000000     // Max nr. of moves the reference simulates for a tape, before giving up on the case
+#define OUTPUTSIZE 4096
+#define TRACKMACHINES 200           // Machines of the multi-track batch, each with a composite symbol of its own
+#define BATCHMACHINES 8             // Machines of a random batch
+
+typedef enum {false, true} bool;
+
+// Input format a random machine is written in
+typedef enum {
+    LayoutPlain,                    // Standard single tape format
+    LayoutTapes,                    // Two tapes, with the second one always blank and still
+    LayoutTracks                    // Two tracks, with the second one always blank
+} Layout;
+
+// Definition of an engine configuration
+typedef struct {
+    const char * Options;           // Simulator options. A %s is replaced by a scratch path prefix
+    Layout Format;
+} Engine;
+
+// Definition of a transition of a random machine
+typedef struct {
+    int From;
+    char Read;
+    char Write;
+    char Move;
+    int To;
+} Rule;
+
+// Definition of a random machine with its tapes
+typedef struct {
+    Rule Rules[MAXRULES + WIDEPADDING];
+    int RuleCount;
+    int Accept[MAXACCEPT];
+    int AcceptCount;
+    long MaxMoves;
+    char Tapes[MAXTAPES][MAXTAPELENGTH + 1];
+    int TapeCount;
+} Machine;
+
+// Definition of the state of a reference simulation
+typedef struct {
+    const Machine * M;
+    char * Cells;                   // Tape, wide enough for the head to go max moves away from either end
+    long Spent;                     // Nr. of simulated moves
+    bool Undetermined;
+} Reference;
+
+// Definition of the state of a branch printed by TraceTool, as CheckTrace follows it on the machine
+typedef struct {
+    char * Cells;                   // Tape left by the moves so far, wide enough for max moves either way
+    long Origin;                    // Index in Cells of tape position 0
+    long Head;
+    long Depth;                     // Nr. of moves so far
+    bool States[MAXSTATES + WIDEPADDING];  // States the moves so far can reach
+} Branch;
+
+// Engine configurations. Every configuration also gets a per-tape time limit. Profiling keeps the plain
+// deterministic engine instead of the dense ones
+const Engine Engines[] = {
+    {"-e auto", LayoutPlain},
+    {"-e general", LayoutPlain},
+    {"-e general -s moves", LayoutPlain},
+    {"-e general -s dist", LayoutPlain},
+    {"-e general -s prio", LayoutPlain},
+    {"-e general -V 4096", LayoutPlain},
+    {"-e general -V 64,replace", LayoutPlain},
+    {"-e general -m 1K", LayoutPlain},
+    {"-e general -m 1", LayoutPlain},
+    {"-H huge", LayoutPlain},
+    {"-j", LayoutPlain},
+    {"-C 0", LayoutPlain},
+    {"-d 100000", LayoutPlain},
+    {"-p %s", LayoutPlain},
+    {"-r %s.trace", LayoutPlain},
+    {"-e general -s dist -r %s.trace", LayoutPlain},
+    {"-e general -m 1 -r %s.trace", LayoutPlain},
+    {"-n 2", LayoutTapes},
+    {"-k 2", LayoutTracks},
+};
+
+#define ENGINECOUNT (int) (sizeof(Engines) / sizeof(Engines[0]))
+
+// Configurations for long machines: tapes growing far from the input, long snapshot chains of the heap
+// schedulers, frontiers spilled and read back many times, tape blocks big enough to be mapped on huge pages
+const Engine LongEngines[] = {
+    {"-e auto", LayoutPlain},
+    {"-e general", LayoutPlain},
+    {"-e general -s moves", LayoutPlain},
+    {"-e general -s dist", LayoutPlain},
+    {"-e general -m 1", LayoutPlain},
+    {"-e general -m 4K", LayoutPlain},
+    {"-e general -H huge", LayoutPlain},
+    {"-H huge", LayoutPlain},
+    {"-e general -V 4096", LayoutPlain},
+    {"-e general -m 1 -r %s.trace", LayoutPlain},
+};
+
+#define LONGENGINECOUNT (int) (sizeof(LongEngines) / sizeof(LongEngines[0]))
+
+// Batch configurations, run on many random machines at once
+const char * BatchEngines[] = {
+    "-b -w 1",
+    "-b -w 3 -e general -s dist",
+    "-b -w 2 -k 2",
+};
+
+#define BATCHENGINECOUNT (int) (sizeof(BatchEngines) / sizeof(BatchEngines[0]))
+
+const char * Simulator = NULL;
+
+const char * TraceTool = NULL;      // TraceTool that reads back every trace, if given
+
+char ScratchPrefix[64] = "";        // Prefix of files the simulator writes: profiles and traces
+
+uint64_t RandomState = 1;
+
+int ReplayInputs(const char * Directory);
+
+int CompareNames(const void * a, const void * b);
+
+int CompareDirectory(const char * Directory);
+
+int FuzzEngines(long Cases, bool Long, const char * ReproPath);
+
+int FuzzBatches(long Batches, const char * ReproPath);
+
+int BatchTracks();
+
+int SpillFailure();
+
+void RandomMachine(Machine * M, bool Long);
+
+uint64_t NextRandom();
+
+int RandomInt(int Low, int High);
+
+bool ReferenceRun(const Machine * M, char * Expected);
+
+bool ReferenceExplore(Reference * R, int CurrState, long Head, long MovesLeft);
+
+bool ReferenceChild(Reference * R, const Rule * Next, long Head, long MovesLeft);
+
+bool IsAccepting(const Machine * M, int StateId);
+
+bool WriteMachine(const Machine * M, Layout Format, const char * Path);
+
+void PrintMachine(FILE * File, const Machine * M, Layout Format);
+
+bool RunSimulator(const char * Options, const char * InputPath, const Machine * M, char * Output);
+
+bool CheckTrace(const Machine * M, const char * Output);
+
+void StartBranch(const Machine * M, Branch * B, unsigned long long Tape);
+
+bool FollowMove(const Machine * M, Branch * B, const char * Line);
+
+bool EndBranch(const Machine * M, Branch * B, char Verdict, bool Accepting, unsigned long long Moves);
+
+bool Disagrees(const Machine * M, const Engine * E, const char * MachinePath);
+
+void Minimize(Machine * M, const Engine * E, const char * MachinePath);
+
+void ReportRepro(const Machine * M, const Engine * E, const char * ReproPath);
+
+void TrimOutput(char * Output);
+
+int main(int argc, char ** argv) {
+    const char * InputsPath = NULL, * ReproPath = NULL;
+    char ScratchDirectory[] = "/tmp/DiffTestXXXXXX", ScratchFile[128];
+    const char * Suffixes[] = {".dot", ".folded", ".trace"};
+    long Cases = 200;
+    int Option, Failures = 0, i;
+
+    while ((Option = getopt(argc, argv, "i:n:o:s:T:")) != -1) {
+        switch (Option) {
+            case 'i':
+                InputsPath = optarg;
+                break;
+            case 'n':
+                Cases = strtol(optarg, NULL, 10);
+                break;
+            case 'o':
+                ReproPath = optarg;
+                break;
+            case 's':
+                RandomState = strtoull(optarg, NULL, 10) * 2 + 1;
+                break;
+            case 'T':
+                TraceTool = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-i inputsdir] [-n cases] [-s seed] [-o reprofile] [-T tracetool] simulator\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-i inputsdir] [-n cases] [-s seed] [-o reprofile] [-T tracetool] simulator\n", argv[0]);
+        return 2;
+    }
+    Simulator = argv[optind];
+
+    if (mkdtemp(ScratchDirectory) == NULL) {
+        fprintf(stderr, "ERROR: Cannot create temporary directory\n");
+        return 2;
+    }
+    snprintf(ScratchPrefix, sizeof(ScratchPrefix), "%s/run", ScratchDirectory);
+
+    if (InputsPath != NULL) {
+        Failures += ReplayInputs(InputsPath);
+    }
+    Failures += FuzzEngines(Cases, false, ReproPath);
+    Failures += FuzzEngines(Cases / LONGSHARE, true, ReproPath);
+    Failures += FuzzBatches(Cases / BATCHMACHINES, ReproPath);
+    Failures += BatchTracks();
+    Failures += SpillFailure();
+
+    for (i = 0; i < 3; i++) {
+        snprintf(ScratchFile, sizeof(ScratchFile), "%s%s", ScratchPrefix, Suffixes[i]);
+        unlink(ScratchFile);
+    }
+    rmdir(ScratchDirectory);
+
+    printf("%d failure(s)\n", Failures);
+    return Failures > 0 ? 1 : 0;
+}
+
+int CompareNames(const void * a, const void * b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// Runs every test directory of [Directory], in name order. Returns nr. of failures
+int ReplayInputs(const char * Directory) {
+    DIR * Dir = opendir(Directory);
+    struct dirent * Entry;
+    char ** Names = NULL;
+    size_t Count = 0, i;
+    int Failures = 0;
+
+    if (Dir == NULL) {
+        fprintf(stderr, "ERROR: Cannot open inputs directory %s\n", Directory);
+        return 1;
+    }
+
+    while ((Entry = readdir(Dir)) != NULL) {
+        if (Entry->d_name[0] != '.') {
+            Names = realloc(Names, sizeof(char *) * (Count + 1));
+            Names[Count++] = strdup(Entry->d_name);
+        }
+    }
+    closedir(Dir);
+    qsort(Names, Count, sizeof(char *), CompareNames);
+
+    for (i = 0; i < Count; i++) {
+        char Path[4096];
+
+        snprintf(Path, sizeof(Path), "%s/%s", Directory, Names[i]);
+        Failures += CompareDirectory(Path);
+        free(Names[i]);
+    }
+    free(Names);
+
+    return Failures;
+}
+
+// Runs input_public.txt of [Directory] with every engine reading the standard format and compares results with
+// output_public.txt. Directories whose input isn't a machine are skipped
+int CompareDirectory(const char * Directory) {
+    char InputPath[4096], OutputPath[4096], Expected[OUTPUTSIZE], Output[OUTPUTSIZE], Header[4] = "";
+    FILE * File;
+    size_t Length;
+    int Engine, Failures = 0;
+
+    snprintf(InputPath, sizeof(InputPath), "%s/input_public.txt", Directory);
+    snprintf(OutputPath, sizeof(OutputPath), "%s/output_public.txt", Directory);
+
+    File = fopen(InputPath, "r");
+    if (File == NULL) {
+        return 0;
+    }
+    if (fgets(Header, sizeof(Header), File) == NULL || strcmp(Header, "tr\n") != 0) {
+        printf("SKIP %s: not a machine\n", Directory);
+        fclose(File);
+        return 0;
+    }
+    fclose(File);
+
+    File = fopen(OutputPath, "r");
+    if (File == NULL) {
+        printf("SKIP %s: no expected output\n", Directory);
+        return 0;
+    }
+    Length = fread(Expected, 1, sizeof(Expected) - 1, File);
+    Expected[Length] = '\0';
+    fclose(File);
+    TrimOutput(Expected);
+
+    for (Engine = 0; Engine < ENGINECOUNT; Engine++) {
+        if (Engines[Engine].Format != LayoutPlain) {
+            continue;
+        }
+        if (RunSimulator(Engines[Engine].Options, InputPath, NULL, Output) == false || strcmp(Output, Expected) != 0) {
+            printf("FAIL %s with %s\n", Directory, Engines[Engine].Options);
+            Failures++;
+        }
+    }
+    if (Failures == 0) {
+        printf("OK %s\n", Directory);
+    }
+
+    return Failures;
+}
+
+// Compares every engine with the reference on [Cases] random machines, [Long] ones with the long engines.
+// Returns nr. of failures
+int FuzzEngines(long Cases, bool Long, const char * ReproPath) {
+    char MachinePath[] = "/tmp/DiffTestXXXXXX", Expected[OUTPUTSIZE], Output[OUTPUTSIZE];
+    const Engine * List = (Long == true) ? LongEngines : Engines;
+    int Count = (Long == true) ? LONGENGINECOUNT : ENGINECOUNT;
+    Machine M;
+    long Case, Skipped = 0;
+    int Engine, Failures = 0, Descriptor = mkstemp(MachinePath);
+
+    if (Descriptor < 0) {
+        fprintf(stderr, "ERROR: Cannot create temporary machine file\n");
+        return 1;
+    }
+    close(Descriptor);
+
+    for (Case = 0; Case < Cases && Failures == 0; Case++) {
+        RandomMachine(&M, Long);
+        if (ReferenceRun(&M, Expected) == false) {
+            Skipped++;
+            continue;
+        }
+
+        for (Engine = 0; Engine < Count; Engine++) {
+            WriteMachine(&M, List[Engine].Format, MachinePath);
+            if (RunSimulator(List[Engine].Options, MachinePath, &M, Output) == false || strcmp(Output, Expected) != 0) {
+                printf("FAIL random %scase %ld with %s\n", (Long == true) ? "long " : "", Case, List[Engine].Options);
+                Minimize(&M, &List[Engine], MachinePath);
+                ReportRepro(&M, &List[Engine], ReproPath);
+                Failures++;
+                break;
+            }
+        }
+    }
+
+    printf("%s %ld random %smachines, %ld skipped as too large for the reference\n", Failures == 0 ? "OK" : "FAIL", Case,
+           (Long == true) ? "long " : "", Skipped);
+    unlink(MachinePath);
+    return Failures;
+}
+
+// Runs [Batches] batches of random machines with every batch configuration. A failing batch is printed, and
+// written to reprofile, if given
+int FuzzBatches(long Batches, const char * ReproPath) {
+    char BatchPath[] = "/tmp/DiffTestXXXXXX", Expected[OUTPUTSIZE], Output[OUTPUTSIZE], Results[OUTPUTSIZE];
+    Machine M[BATCHMACHINES];
+    long Batch;
+    int i, Count, Engine, Failures = 0, Descriptor = mkstemp(BatchPath);
+    FILE * File;
+
+    if (Descriptor < 0) {
+        fprintf(stderr, "ERROR: Cannot create temporary batch file\n");
+        return 1;
+    }
+    close(Descriptor);
+
+    for (Batch = 0; Batch < Batches && Failures == 0; Batch++) {
+        Expected[0] = '\0';
+        for (Count = 0; Count < BATCHMACHINES; ) {
+            RandomMachine(&M[Count], false);
+            if (ReferenceRun(&M[Count], Results) == true) {
+                strcat(Expected, Results);
+                strcat(Expected, "\n---\n");
+                Count++;
+            }
+        }
+        TrimOutput(Expected);
+
+        for (Engine = 0; Engine < BATCHENGINECOUNT && Failures == 0; Engine++) {
+            Layout Format = (strstr(BatchEngines[Engine], "-k") != NULL) ? LayoutTracks : LayoutPlain;
+
+            File = fopen(BatchPath, "w");
+            for (i = 0; i < Count && File != NULL; i++) {
+                PrintMachine(File, &M[i], Format);
+                fprintf(File, "---\n");
+            }
+            if (File != NULL) {
+                fclose(File);
+            }
+
+            if (RunSimulator(BatchEngines[Engine], BatchPath, NULL, Output) == false || strcmp(Output, Expected) != 0) {
+                printf("FAIL random batch %ld with %s\n", Batch, BatchEngines[Engine]);
+                File = fopen(BatchPath, "r");
+                while (File != NULL && fgets(Results, sizeof(Results), File) != NULL) {
+                    printf("  %s", Results);
+                }
+                if (File != NULL) {
+                    fclose(File);
+                }
+                printf("Expected:\n%s\nGot:\n%s\n", Expected, Output);
+                if (ReproPath != NULL) {
+                    rename(BatchPath, ReproPath);
+                }
+                Failures++;
+            }
+        }
+    }
+
+    printf("%s %ld random batches of %d machines\n", Failures == 0 ? "OK" : "FAIL", Batch, BATCHMACHINES);
+    unlink(BatchPath);
+    return Failures;
+}
+
+// Runs a multi-track batch with more composite symbols than a single machine may have, as every machine must
+// start from an empty symbol table. Each machine writes its own symbol pair over an input symbol it only matches
+// with a wildcard, and accepts only if it reads the pair back
+int BatchTracks() {
+    char BatchPath[] = "/tmp/DiffTestXXXXXX", Expected[OUTPUTSIZE] = "", Output[OUTPUTSIZE];
+    const char * Options[] = {"-b -w 1 -k 2", "-b -w 3 -k 2"};
+    int i, Failures = 0, Descriptor = mkstemp(BatchPath);
+    FILE * File;
+
+    if (Descriptor < 0 || (File = fdopen(Descriptor, "w")) == NULL) {
+        fprintf(stderr, "ERROR: Cannot create temporary batch file\n");
+        return 1;
+    }
+    for (i = 0; i < TRACKMACHINES; i++) {
+        char First = (char) ('A' + i / 26), Second = (char) ('a' + i % 26);
+
+        fprintf(File, "tr\n0 *_ %c%c R 1\n1 __ __ L 2\n2 %c%c %c%c R 3\nacc\n3\nmax\n10\nrun\nc\ncc\n---\n",
+                First, Second, First, Second, First, Second);
+        strcat(Expected, "1\n0\n---\n");
+    }
+    fclose(File);
+    TrimOutput(Expected);
+
+    for (i = 0; i < (int) (sizeof(Options) / sizeof(Options[0])); i++) {
+        if (RunSimulator(Options[i], BatchPath, NULL, Output) == false || strcmp(Output, Expected) != 0) {
+            printf("FAIL multi-track batch with %s\n", Options[i]);
+            Failures++;
+        }
+    }
+    if (Failures == 0) {
+        printf("OK multi-track batch of %d machines\n", TRACKMACHINES);
+    }
+
+    unlink(BatchPath);
+    return Failures;
+}
+
+// Runs a machine that only accepts on its first branch, left at the bottom of a deep stack, with a spill file
+// that can't grow past a few blocks. The simulator must exit with an error rather than drop spilled branches
+int SpillFailure() {
+    char MachinePath[] = "/tmp/DiffTestXXXXXX", Command[8192], Output[OUTPUTSIZE];
+    FILE * File, * Pipe;
+    size_t Length;
+    int Status, Descriptor = mkstemp(MachinePath);
+
+    if (Descriptor < 0 || (File = fdopen(Descriptor, "w")) == NULL) {
+        fprintf(stderr, "ERROR: Cannot create temporary machine file\n");
+        return 1;
+    }
+    fprintf(File, "tr\n0 x x R 0\n0 _ b R 0\n0 _ a L 1\n1 x x S 2\nacc\n2\nmax\n3000\nrun\nx\n");
+    fclose(File);
+
+    // Writes past the file size limit fail with EFBIG instead of raising SIGXFSZ, as the signal is ignored
+    snprintf(Command, sizeof(Command), "ulimit -f 4; trap '' XFSZ; '%s' -e general -m 1 < '%s' 2>&1", Simulator, MachinePath);
+    Pipe = popen(Command, "r");
+    if (Pipe == NULL) {
+        unlink(MachinePath);
+        return 1;
+    }
+    Length = fread(Output, 1, OUTPUTSIZE - 1, Pipe);
+    Output[Length] = '\0';
+    TrimOutput(Output);
+    Status = pclose(Pipe);
+    unlink(MachinePath);
+
+    if (Status == 0 || strncmp(Output, "ERROR: Cannot write spill file", 30) != 0) {
+        printf("FAIL spill file failure: got %s\n", Output);
+        return 1;
+    }
+    printf("OK spill file failure\n");
+    return 0;
+}
+
+// Random machine in the style of the public inputs: few states, small alphabet, short tapes, that may hold
+// blanks. Half of the machines are deterministic, so that the specialized deterministic engines are exercised
+// too. One machine in eight is wide: its reachable states come after WIDEPADDING unreachable ones, so that
+// state sets take more than a word. A [Long] machine has up to LONGMAXMOVES max moves, and its first state
+// walks over blanks, so that its head can get far from the input
+void RandomMachine(Machine * M, bool Long) {
+    const char * Alphabets[] = {"a", "ab", "abc"};
+    const char * Alphabet = Alphabets[RandomInt(0, 2)];
+    int StateTotal = RandomInt(1, MAXSTATES - 1), SymbolTotal = (int) strlen(Alphabet) + 1, Attempts = RandomInt(1, 18);
+    bool Deterministic = (RandomInt(0, 1) == 1), Wide = (RandomInt(0, 7) == 0), Used[MAXSTATES] = {false};
+    int i, j, Length;
+
+    M->RuleCount = 0;
+    Used[0] = true;
+    for (i = 0; i < Attempts; i++) {
+        Rule New;
+        bool Skip = false;
+
+        New.From = RandomInt(0, StateTotal - 1);
+        New.Read = (RandomInt(0, SymbolTotal - 1) == 0) ? '_' : Alphabet[RandomInt(0, SymbolTotal - 2)];
+        New.Write = (RandomInt(0, SymbolTotal - 1) == 0) ? '_' : Alphabet[RandomInt(0, SymbolTotal - 2)];
+        New.Move = "LRS"[RandomInt(0, 2)];
+        New.To = RandomInt(0, StateTotal - 1);
+
+        for (j = 0; j < M->RuleCount; j++) {
+            const Rule * Old = &M->Rules[j];
+
+            if (Old->From == New.From && Old->Read == New.Read &&
+                (Deterministic == true || (Old->Write == New.Write && Old->Move == New.Move && Old->To == New.To))) {
+                Skip = true;
+            }
+        }
+        if (Skip == false) {
+            M->Rules[M->RuleCount++] = New;
+            Used[New.From] = true;
+            Used[New.To] = true;
+        }
+    }
+
+    // The walk of a nondeterministic machine also branches off to another state at every step, so that its
+    // branches get deep enough for long snapshot chains
+    for (i = (Long == true) ? ((Deterministic == true || StateTotal == 1) ? 1 : 2) : 0; i > 0; i--) {
+        Rule Walk = {0, '_', Alphabet[RandomInt(0, SymbolTotal - 2)], "LR"[RandomInt(0, 1)], 0};
+        bool Skip = false;
+
+        if (i == 2) {
+            Walk.Move = "LRS"[RandomInt(0, 2)];
+            Walk.To = RandomInt(1, StateTotal - 1);
+        }
+        for (j = 0; j < M->RuleCount; j++) {
+            const Rule * Old = &M->Rules[j];
+
+            if (Old->From == 0 && Old->Read == '_' &&
+                (Deterministic == true || (Old->Write == Walk.Write && Old->Move == Walk.Move && Old->To == Walk.To))) {
+                Skip = true;
+            }
+        }
+        if (Skip == false) {
+            M->Rules[M->RuleCount++] = Walk;
+            Used[Walk.To] = true;
+        }
+    }
+
+    M->AcceptCount = 0;
+    for (i = RandomInt(0, 2); i > 0; i--) {
+        int Candidate = RandomInt(0, StateTotal - 1);
+
+        if (Used[Candidate] == true && IsAccepting(M, Candidate) == false) {
+            M->Accept[M->AcceptCount++] = Candidate;
+        }
+    }
+
+    if (Wide == true) {
+        for (i = 0; i < M->RuleCount; i++) {
+            M->Rules[i].From += (M->Rules[i].From != 0) ? WIDEPADDING : 0;
+            M->Rules[i].To += (M->Rules[i].To != 0) ? WIDEPADDING : 0;
+        }
+        for (i = 0; i < M->AcceptCount; i++) {
+            M->Accept[i] += (M->Accept[i] != 0) ? WIDEPADDING : 0;
+        }
+        for (i = 1; i <= WIDEPADDING; i++) {
+            Rule Padding = {i, '_', '_', 'R', i % WIDEPADDING + 1};
+
+            M->Rules[M->RuleCount++] = Padding;
+        }
+    }
+
+    M->MaxMoves = (Long == true) ? RandomInt(MAXMOVES + 1, LONGMAXMOVES) : RandomInt(1, MAXMOVES);
+    M->TapeCount = RandomInt(1, MAXTAPES);
+    for (i = 0; i < M->TapeCount; i++) {
+        Length = RandomInt(1, MAXTAPELENGTH);
+        for (j = 0; j < Length; j++) {
+            M->Tapes[i][j] = (RandomInt(0, SymbolTotal) == 0) ? '_' : Alphabet[RandomInt(0, SymbolTotal - 2)];
+        }
+        M->Tapes[i][Length] = '\0';
+    }
+}
+
+// Splitmix64, so that a seed gives the same machines everywhere
+uint64_t NextRandom() {
+    uint64_t z = (RandomState += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+int RandomInt(int Low, int High) {
+    return Low + (int) (NextRandom() % (uint64_t) (High - Low + 1));
+}
+
+// Writes in [Expected] the result of every tape of [M] as the simulator prints them. Returns false if the
+// reference ran out of budget
+bool ReferenceRun(const Machine * M, char * Expected) {
+    Reference R;
+    size_t Size = (size_t) (2 * M->MaxMoves + MAXTAPELENGTH + 2);
+    int t, r;
+
+    R.M = M;
+    R.Cells = malloc(Size);
+    Expected[0] = '\0';
+
+    for (t = 0; t < M->TapeCount; t++) {
+        bool Accepted = false;
+        long Origin = M->MaxMoves + 1;
+
+        memset(R.Cells, '_', Size);
+        memcpy(R.Cells + Origin, M->Tapes[t], strlen(M->Tapes[t]));
+        R.Spent = 0;
+        R.Undetermined = false;
+
+        // First moves are made even from self loops, and an accepting initial state doesn't accept
+        for (r = 0; r < M->RuleCount && Accepted == false; r++) {
+            if (M->Rules[r].From == 0 && M->Rules[r].Read == R.Cells[Origin]) {
+                Accepted = ReferenceChild(&R, &M->Rules[r], Origin, M->MaxMoves);
+            }
+        }
+        if (R.Spent > REFERENCEBUDGET) {
+            free(R.Cells);
+            return false;
+        }
+
+        strcat(Expected, Accepted == true ? "1\n" : R.Undetermined == true ? "U\n" : "0\n");
+    }
+
+    free(R.Cells);
+    TrimOutput(Expected);
+    return true;
+}
+
+// True if some branch from [CurrState], with head on [Head] and [MovesLeft] moves left, accepts. Branches that
+// run out of moves, or reach a self loop that doesn't move the head, make the result U
+bool ReferenceExplore(Reference * R, int CurrState, long Head, long MovesLeft) {
+    char Read = R->Cells[Head];
+    int r;
+
+    if (MovesLeft <= 0) {
+        R->Undetermined = true;
+        return false;
+    }
+    if (IsAccepting(R->M, CurrState) == true) {
+        return true;
+    }
+
+    for (r = 0; r < R->M->RuleCount; r++) {
+        const Rule * Next = &R->M->Rules[r];
+
+        if (Next->From != CurrState || Next->Read != Read) {
+            continue;
+        }
+        if (Next->Move == 'S' && Next->Write == Read && Next->To == CurrState) {
+            R->Undetermined = true;
+            continue;
+        }
+        if (ReferenceChild(R, Next, Head, MovesLeft) == true) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Runs [Next] from [Head], then explores from where it leads
+bool ReferenceChild(Reference * R, const Rule * Next, long Head, long MovesLeft) {
+    char Old = R->Cells[Head];
+    bool Accepted;
+
+    if (++R->Spent > REFERENCEBUDGET) {
+        return false;
+    }
+
+    R->Cells[Head] = Next->Write;
+    Accepted = ReferenceExplore(R, Next->To, Head + (Next->Move == 'R' ? 1 : Next->Move == 'L' ? -1 : 0), MovesLeft - 1);
+    R->Cells[Head] = Old;
+
+    return Accepted;
+}
+
+bool IsAccepting(const Machine * M, int StateId) {
+    int i;
+
+    for (i = 0; i < M->AcceptCount; i++) {
+        if (M->Accept[i] == StateId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Writes [M] in [Format]
+bool WriteMachine(const Machine * M, Layout Format, const char * Path) {
+    FILE * File = fopen(Path, "w");
+
+    if (File == NULL) {
+        return false;
+    }
+
+    PrintMachine(File, M, Format);
+    fclose(File);
+    return true;
+}
+
+// Prints [M] in [Format]. Extra tapes and tracks are blank, and never written nor moved on
+void PrintMachine(FILE * File, const Machine * M, Layout Format) {
+    int i;
+
+    fprintf(File, "tr\n");
+    for (i = 0; i < M->RuleCount; i++) {
+        const Rule * Next = &M->Rules[i];
+
+        if (Format == LayoutTapes) {
+            fprintf(File, "%d %c_ %c_ %cS %d\n", Next->From, Next->Read, Next->Write, Next->Move, Next->To);
+        } else if (Format == LayoutTracks) {
+            fprintf(File, "%d %c_ %c_ %c %d\n", Next->From, Next->Read, Next->Write, Next->Move, Next->To);
+        } else {
+            fprintf(File, "%d %c %c %c %d\n", Next->From, Next->Read, Next->Write, Next->Move, Next->To);
+        }
+    }
+    fprintf(File, "acc\n");
+    for (i = 0; i < M->AcceptCount; i++) {
+        fprintf(File, "%d\n", M->Accept[i]);
+    }
+    fprintf(File, "max\n%ld\nrun\n", M->MaxMoves);
+    for (i = 0; i < M->TapeCount; i++) {
+        fprintf(File, "%s\n", M->Tapes[i]);
+    }
+}
+
+// Runs simulator with [Options] on [InputPath], with output in [Output]. Returns false if it didn't exit cleanly,
+// or if its trace doesn't read back right. [M] is the machine of InputPath, if known
+bool RunSimulator(const char * Options, const char * InputPath, const Machine * M, char * Output) {
+    char Command[8192], Expanded[512];
+    FILE * Pipe;
+    size_t Length;
+
+    snprintf(Expanded, sizeof(Expanded), Options, ScratchPrefix);
+    snprintf(Command, sizeof(Command), "'%s' -t 10000 %s < '%s' 2>/dev/null", Simulator, Expanded, InputPath);
+    Pipe = popen(Command, "r");
+    if (Pipe == NULL) {
+        return false;
+    }
+
+    Length = fread(Output, 1, OUTPUTSIZE - 1, Pipe);
+    Output[Length] = '\0';
+    TrimOutput(Output);
+
+    if (pclose(Pipe) != 0) {
+        return false;
+    }
+    return TraceTool == NULL || strstr(Options, "-r ") == NULL || CheckTrace(M, Output) == true;
+}
+
+// Reads back with TraceTool the trace of the last run, whose results were [Output]. Every tape must be decoded
+// whole, with the verdict of the simulator. TraceTool checks the moves it decodes for a tape against the ones
+// the simulator counted in its result record, and stops decoding at the first tape where they differ. If
+// machine [M] is known, the branch shown for every tape must also be one of its runs, ending in an acceptance
+// state if the tape was accepted
+bool CheckTrace(const Machine * M, const char * Output) {
+    char Command[8192], Line[4096], Verdict = '\0';
+    const char * Expected = Output;
+    unsigned long long Moves = 0;
+    bool Matches = true, Accepting = false;
+    Branch B;
+    FILE * Pipe;
+
+    snprintf(Command, sizeof(Command), "'%s' show '%s.trace' 2>&1", TraceTool, ScratchPrefix);
+    Pipe = popen(Command, "r");
+    if (Pipe == NULL) {
+        return false;
+    }
+
+    B.Cells = NULL;
+    while (fgets(Line, sizeof(Line), Pipe) != NULL) {
+        unsigned long long Tape, TapeMoves;
+        long long Length;
+        char TapeVerdict;
+
+        if (strncmp(Line, "WARNING", 7) == 0 || strncmp(Line, "ERROR", 5) == 0) {
+            Matches = false;
+        } else if (sscanf(Line, "Tape %llu, length %lld: result %c, %llu moves", &Tape, &Length, &TapeVerdict, &TapeMoves) == 4) {
+            if (*Expected != TapeVerdict) {
+                Matches = false;
+            } else {
+                Expected += (Expected[1] == '\n') ? 2 : 1;
+            }
+            if (M != NULL && B.Cells != NULL && EndBranch(M, &B, Verdict, Accepting, Moves) == false) {
+                Matches = false;
+            }
+            Verdict = TapeVerdict;
+            Moves = TapeMoves;
+            if (M != NULL && Tape < (unsigned long long) M->TapeCount) {
+                StartBranch(M, &B, Tape);
+                Accepting = false;
+            } else if (M != NULL) {
+                Matches = false;
+            }
+        } else if (strcmp(Line, "  Accepting branch:\n") == 0) {
+            Accepting = true;
+        } else if (M != NULL && B.Cells != NULL && Line[0] == ' ' && Line[2] == ' ' && FollowMove(M, &B, Line) == false) {
+            Matches = false;
+        }
+    }
+    if (M != NULL && B.Cells != NULL && EndBranch(M, &B, Verdict, Accepting, Moves) == false) {
+        Matches = false;
+    }
+    free(B.Cells);
+
+    return pclose(Pipe) == 0 && Matches == true && *Expected == '\0';
+}
+
+// Sets [B] at the start of tape nr. [Tape] of [M]
+void StartBranch(const Machine * M, Branch * B, unsigned long long Tape) {
+    size_t Size = (size_t) (2 * M->MaxMoves + MAXTAPELENGTH + 2);
+
+    free(B->Cells);
+    B->Cells = malloc(Size);
+    memset(B->Cells, '_', Size);
+    B->Origin = M->MaxMoves + 1;
+    memcpy(B->Cells + B->Origin, M->Tapes[Tape], strlen(M->Tapes[Tape]));
+    B->Head = 0;
+    B->Depth = 0;
+    memset(B->States, 0, sizeof(B->States));
+    B->States[0] = true;
+}
+
+// Follows on [B] the move printed on [Line] by TraceTool. False if no state of B has such a transition, or the move
+// isn't the next one of B. A move reaching more states only prints the lowest one, so B keeps all the states the
+// move can reach
+bool FollowMove(const Machine * M, Branch * B, const char * Line) {
+    bool Reached[MAXSTATES + WIDEPADDING] = {false};
+    const char * Head = strstr(Line, ", head ");
+    unsigned long long Depth;
+    unsigned int State;
+    long long Position;
+    char Read, Write, Move;
+    int r;
+
+    if (sscanf(Line, "%llu: read %c write %c move %c -> state %u", &Depth, &Read, &Write, &Move, &State) != 5 ||
+        Head == NULL || sscanf(Head, ", head %lld", &Position) != 1) {
+        return false;
+    }
+    if (Depth != (unsigned long long) B->Depth + 1 || B->Depth >= M->MaxMoves || B->Cells[B->Origin + B->Head] != Read ||
+        State >= MAXSTATES + WIDEPADDING) {
+        return false;
+    }
+
+    for (r = 0; r < M->RuleCount; r++) {
+        const Rule * Next = &M->Rules[r];
+
+        if (B->States[Next->From] == true && Next->Read == Read && Next->Write == Write && Next->Move == Move) {
+            Reached[Next->To] = true;
+        }
+    }
+    if (Reached[State] == false) {
+        return false;
+    }
+
+    if (strstr(Line, " (+") != NULL) {
+        memcpy(B->States, Reached, sizeof(B->States));
+    } else {
+        memset(B->States, 0, sizeof(B->States));
+        B->States[State] = true;
+    }
+    B->Cells[B->Origin + B->Head] = Write;
+    B->Head += (Move == 'L') ? -1 : (Move == 'R') ? 1 : 0;
+    B->Depth++;
+
+    return Position == B->Head;
+}
+
+// False if [B], the branch shown for a tape with [Verdict], can't be right: an [Accepting] branch must end where
+// some of its states accept within the moves left, as the engine stops as soon as a state surely accepts, and
+// an accepted tape with no accepting branch can't have moved
+bool EndBranch(const Machine * M, Branch * B, char Verdict, bool Accepting, unsigned long long Moves) {
+    Reference R;
+    int s;
+
+    if (Verdict != '1') {
+        return Accepting == false;
+    }
+    if (Accepting == false && Moves > 0) {
+        return false;
+    }
+
+    R.M = M;
+    R.Cells = B->Cells;
+    R.Spent = 0;
+    R.Undetermined = false;
+    for (s = 0; s < MAXSTATES + WIDEPADDING; s++) {
+        if (B->States[s] == true && ReferenceExplore(&R, s, B->Origin + B->Head, M->MaxMoves - B->Depth) == true) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Disagrees(const Machine * M, const Engine * E, const char * MachinePath) {
+    char Expected[OUTPUTSIZE], Output[OUTPUTSIZE];
+
+    if (ReferenceRun(M, Expected) == false || WriteMachine(M, E->Format, MachinePath) == false) {
+        return false;
+    }
+    return RunSimulator(E->Options, MachinePath, M, Output) == false || strcmp(Output, Expected) != 0;
+}
+
+// Shrinks [M] while engine [E] still disagrees with the reference: drops tapes, transitions and acceptance
+// states, lowers max moves and shortens tapes, until nothing can be removed. Max moves are lowered by halving
+// steps, as long machines have thousands
+void Minimize(Machine * M, const Engine * E, const char * MachinePath) {
+    bool Shrunk = true;
+    Machine Candidate;
+    long Step;
+    int i, j;
+
+    while (Shrunk == true) {
+        Shrunk = false;
+
+        for (i = 0; i < M->TapeCount && M->TapeCount > 1; i++) {
+            Candidate = *M;
+            memmove(Candidate.Tapes[i], Candidate.Tapes[i + 1], sizeof(Candidate.Tapes[0]) * (size_t) (Candidate.TapeCount - i - 1));
+            Candidate.TapeCount--;
+            if (Disagrees(&Candidate, E, MachinePath) == true) {
+                *M = Candidate;
+                Shrunk = true;
+                i--;
+            }
+        }
+
+        for (i = 0; i < M->RuleCount; i++) {
+            Candidate = *M;
+            memmove(&Candidate.Rules[i], &Candidate.Rules[i + 1], sizeof(Rule) * (size_t) (Candidate.RuleCount - i - 1));
+            Candidate.RuleCount--;
+            if (Disagrees(&Candidate, E, MachinePath) == true) {
+                *M = Candidate;
+                Shrunk = true;
+                i--;
+            }
+        }
+
+        for (i = 0; i < M->AcceptCount; i++) {
+            Candidate = *M;
+            Candidate.Accept[i] = Candidate.Accept[--Candidate.AcceptCount];
+            if (Disagrees(&Candidate, E, MachinePath) == true) {
+                *M = Candidate;
+                Shrunk = true;
+                i--;
+            }
+        }
+
+        for (Step = M->MaxMoves / 2; Step > 0; Step /= 2) {
+            while (M->MaxMoves > Step) {
+                Candidate = *M;
+                Candidate.MaxMoves -= Step;
+                if (Disagrees(&Candidate, E, MachinePath) == false) {
+                    break;
+                }
+                *M = Candidate;
+                Shrunk = true;
+            }
+        }
+
+        for (i = 0; i < M->TapeCount; i++) {
+            for (j = 0; M->Tapes[i][j] != '\0' && M->Tapes[i][1] != '\0'; j++) {
+                Candidate = *M;
+                memmove(&Candidate.Tapes[i][j], &Candidate.Tapes[i][j + 1], strlen(&Candidate.Tapes[i][j]));
+                if (Disagrees(&Candidate, E, MachinePath) == true) {
+                    *M = Candidate;
+                    Shrunk = true;
+                    j--;
+                }
+            }
+        }
+    }
+}
+
+// Prints minimized machine, expected and actual results
+void ReportRepro(const Machine * M, const Engine * E, const char * ReproPath) {
+    char MachinePath[] = "/tmp/DiffTestXXXXXX", Expected[OUTPUTSIZE], Output[OUTPUTSIZE], Line[256];
+    int Descriptor = mkstemp(MachinePath);
+    FILE * File;
+
+    if (Descriptor < 0) {
+        return;
+    }
+    close(Descriptor);
+
+    WriteMachine(M, E->Format, MachinePath);
+    ReferenceRun(M, Expected);
+    if (RunSimulator(E->Options, MachinePath, M, Output) == false) {
+        strcat(Output, " (abnormal exit)");
+    }
+
+    printf("Repro for %s:\n", E->Options);
+    File = fopen(MachinePath, "r");
+    while (File != NULL && fgets(Line, sizeof(Line), File) != NULL) {
+        printf("  %s", Line);
+    }
+    if (File != NULL) {
+        fclose(File);
+    }
+    printf("Expected:\n%s\nGot:\n%s\n", Expected, Output);
+
+    if (ReproPath != NULL) {
+        WriteMachine(M, E->Format, ReproPath);
+    }
+    unlink(MachinePath);
+}
+
+// Drops trailing newlines, as expected outputs may miss the last one
+void TrimOutput(char * Output) {
+    size_t Length = strlen(Output);
+
+    while (Length > 0 && (Output[Length - 1] == '\n' || Output[Length - 1] == '\r')) {
+        Output[--Length] = '\0';
+    }
+}
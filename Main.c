@@ -1,9 +1,53 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "Trace.h"
 
 #define INSTRLENGTH 5
 #define TRLENGTH 27
+#define CACHECAPACITY 4096
+#define FNVOFFSET 14695981039346656037ULL
+#define FNVPRIME 1099511628211ULL
+#define CACHEMAGIC 0x3345484341434D54ULL  // "TMCACHE3", Fingerprint of the first record of a cache file
+#define KEYBLOCK 16
+#define SPILLBATCH 4096
+#define TIMECHECKSTEPS 4096
+#define MAXTRACKS 8
+#define FIRSTTRACKCODE 128
+#define MAXTAPES 8
+#define TRACEBUFFER 65536
+#define VISITEDPROBES 16
+#define VISITEDTAGBITS 48
+#define ZOBRISTSEEDA 0x9E3779B97F4A7C15ULL
+#define ZOBRISTSEEDB 0xC2B2AE3D27D4EB4FULL
+#define HEAPARITY 4
+#define RINGSIZE 256
+#define SNAPSHOTCHAIN 16
+#define HUGEPAGESIZE (2UL << 20)
+#define LARGEHEADER 64              // Header of large blocks, keeping them cache line aligned
+#define BATCHDELIMITER "---\n"       // Line ending a machine of batch mode, in input and output
+#define DENSENONE 3                 // Handler of no transition for the symbol (after the MoveKind handlers)
+#define DENSESLOW 4                 // Handler of more than one transition, or a chain to acceptance: looked up as in RunDeterministic
+#define DENSELOOP 5                 // Handler of single self loop that doesn't move the head
+#define DENSEMAXBYTES (64 << 20)
+#define DENSESTEP(ToState, Write, Handler) ((uint64_t) (ToState) | (uint64_t) (unsigned char) (Write) << 32 | (uint64_t) (Handler) << 40)
+#define NOACCEPT UINT32_MAX
 
 typedef enum {
     false,
@@ -39,13 +83,45 @@ typedef struct  CHARACTER{
     struct CHARACTER * Next;        // Ptr to next list
 } TransitionList;
 
+// Head movements of packed transitions
+typedef enum {
+    MoveLeft,
+    MoveRight,
+    MoveStay
+} MoveKind;
+
+// Definition of packed transition, as used by the engines once the machine is loaded
+typedef struct {
+    uint32_t ToState;               // Index of destination state in States
+    char Write;                     // Write char in memory tape
+    unsigned char Move;             // Direction where tape head moves (MoveKind)
+} PackedTransition;
+
 // Definition of STATE
 struct STATE {
     unsigned int id;                         // Name of state
     bool IsAcceptanceState;         // True if this state is an acceptance state (TransitionList is NULL as convention)
-    TransitionList * CharacterList;     // List of all state's transitions
+    TransitionList * CharacterList;     // List of all state's transitions (freed once machine is packed)
+    unsigned int Index;             // Index of state in States
+    unsigned int KeyCount;          // Nr. of read chars that have transitions
+    char * Keys;                    // Read chars that have transitions (KEYBLOCK-aligned)
+    uint32_t * FirstTransition;     // Transitions of Keys[k] are Packed[FirstTransition[k]] to Packed[FirstTransition[k + 1] - 1]
+    uint32_t * FirstGroup;          // Tape effects of Keys[k] are Groups[FirstGroup[k]] to Groups[FirstGroup[k + 1] - 1]
+    uint32_t * AcceptDistance;      // Min nr. of moves to acceptance reading Keys[k] without moving the head (NOACCEPT if none)
+    uint32_t GoalDistance;          // Min nr. of moves to an acceptance state on state graph, whatever the tape (NOACCEPT if none)
+    long Priority;                  // User priority of state (-P)
 };
 
+// Definition of the transitions of a state and read char that share a tape effect
+typedef struct {
+    char Write;                     // Write char in memory tape
+    unsigned char Move;             // Direction where tape head moves (MoveKind)
+    bool HasLoop;                   // True if the group has a self loop that doesn't move the head (not in Targets)
+    uint32_t Targets;               // Offset in TargetPool of the bitset of destination states
+    uint32_t Lowest;                // Index of first state of Targets, the one with lowest id (UINT32_MAX if none)
+    uint32_t StateCount;            // Nr. of states of Targets
+} EffectGroup;
+
 // Definition of Red-Black Tree node
 typedef struct RB {
     State * StatePtr;
@@ -61,1280 +137,5041 @@ typedef struct {
     TreeNode * nil;
 } RB_Tree;
 
+// Definition of overwritten symbol version. Versions are kept in write order on WriteLog, so that they are
+// allocated and freed as a stack
 typedef struct SYMBOL {
-    int BranchID;
-	unsigned long int SymbolQty;
-	unsigned long int CurrSymbol;
+    long Position;                  // Cell the symbol was overwritten in
+    long Next;                      // Index in WriteLog of previous older symbol of the same cell (-1 if none)
+    int BranchID;                   // Branch that wrote the symbol
 	char Symbol;
-    struct SYMBOL * Next;
 } Symbol;
 
-// Definition of Memory tape cell
+// Definition of Memory tape cell versions. The symbol of a cell, as seen by current branch, is kept apart in
+// HalfTape Symbols. Symbols of branch 0 (the input, and moves before the first nondeterministic one) are only
+// undone by ResetTape, so they have no versions: both fields stay -1, as in a blank cell
 typedef struct CELL {
-    Symbol * Symbols;                    // Content of the cell
-    struct CELL * Left;                 // Ptr to left cell
-    struct CELL * Right;                // Ptr to right cell
-
+    int BranchID;                   // Branch that wrote the symbol (-1 if blank, or written by branch 0)
+    long Older;                     // Index in WriteLog of newest symbol overwritten by newer branches (-1 if none)
 } Cell;
 
+// Definition of half memory tape, as growable arrays of blank-initialized symbols and their versions.
+// Symbols are contiguous, so that tapes are loaded and blanked in bulk
+typedef struct {
+    char * Symbols;
+    Cell * Cells;
+    long Size;                      // Allocated cells
+} HalfTape;
+
+// Definition of memory tape. Position p >= 0 is cell p of Right, position p < 0 is cell -1 - p of Left
+typedef struct {
+    HalfTape Left;
+    HalfTape Right;
+    long Min;                       // Leftmost touched position
+    long Max;                       // Rightmost touched position
+} Tape;
+
+// Definition of tape snapshot, used by branches that have been spilled to disk or don't run in stack order.
+// A delta snapshot only has the window written since its parent, the rest of the tape is the parent's
+typedef struct SNAPSHOT {
+    int RefCount;                   // Nr. of stack elements and child snapshots sharing this snapshot
+    uint64_t RunCount;              // Nr. of runs of equal symbols
+    int64_t Start;                  // Tape position of first symbol of first run
+    int64_t Head;                   // Tape position of head
+    char * Symbols;                 // Symbol of every run
+    uint64_t * Quantities;          // Length of every run
+    struct SNAPSHOT * Parent;       // Snapshot this one is a delta of (NULL if full)
+    unsigned int Depth;             // Nr. of deltas up to a full snapshot
+} Snapshot;
+
+// Definition of branch: a tape effect shared by sibling transitions, and every state they lead to
 typedef struct STACKEL {
     int BranchID;
     struct STACKEL * Next;
-    Transition * Trans;
-    Cell * MemPositionBuffer;
-	unsigned long int CurrSymbolBuffer;
+    char Write;                     // Write char in memory tape
+    unsigned char Move;             // Direction where tape head moves (MoveKind)
+    long MemPositionBuffer;
     unsigned long int MovesBuffer;
+    Snapshot * Snap;                // Tape of this branch, if it has been paged in from disk (NULL otherwise)
+    uint64_t TraceParent;           // Trace record of the move that pushed this branch
+    uint32_t TraceState;            // Lowest id of Targets, only kept while tracing
+    uint32_t TraceStates;           // Nr. of states of Targets, only kept while tracing
+    bool TraceImplied;              // True if it's the only transition of a single state, so that a trace can replay it
+    uint64_t TapeHash[2];           // Zobrist hashes of tape when branch was pushed
+    size_t FrontierCharge;          // Bytes added to FrontierBytes for this element, taken back as they are
+    uint64_t Targets[];             // Bitset of destination states (SetWords words)
 } StackElem;
 
-// Global variables
-Cell * MemoryTape;
+// Definition of a result cache record, as stored in the on-disk cache file
+typedef struct {
+    uint64_t Fingerprint;           // Fingerprint of the machine that produced the result
+    uint64_t TapeHash;              // Hash of the input tape
+    uint64_t TapeCheck;             // Second hash of the input tape, independent of TapeHash
+    uint64_t MaxMoves;              // Max moves the tape was simulated with
+    uint64_t TapeLength;            // Length of the input tape
+    int32_t Result;                 // Simulation result (0, 1 or 2 for U)
+    uint32_t Padding;               // Always 0, so that no uninitialized bytes reach the cache file
+} CacheRecord;
+
+// Definition of result cache entry (in-memory LRU)
+typedef struct CACHEENTRY {
+    CacheRecord Record;
+    struct CACHEENTRY * HashNext;   // Ptr to next entry in the same bucket
+    struct CACHEENTRY * Newer;      // Ptr to next more recently used entry
+    struct CACHEENTRY * Older;      // Ptr to next less recently used entry
+} CacheEntry;
+
+// Definition of result cache
+typedef struct {
+    CacheEntry ** Buckets;
+    size_t BucketCount;
+    CacheEntry * MostRecent;
+    CacheEntry * LeastRecent;
+    size_t Size;
+    size_t Capacity;
+    int DiskFile;                   // Append-only cache file (-1 if disabled)
+    CacheRecord * DiskRecords;      // Records mapped from cache file at startup
+    size_t DiskRecordCount;
+    size_t * DiskIndex;             // Open addressing index on DiskRecords (entries are record nr. + 1)
+    size_t DiskIndexSize;
+} ResultCache;
+
+// Definition of flat memory tape, used while running deterministic states
+typedef struct {
+    char * Symbols;                 // Content of the tape
+    long Size;                      // Allocated symbols
+    long Origin;                    // Index in [Symbols] of tape position 0
+    long Min;                       // Leftmost written position
+    long Max;                       // Rightmost written position
+} FlatTape;
 
-Cell * CurrMemPosition;
+typedef enum {
+    AutoEngine,                     // Deterministic states on flat tape, the rest on branching engine
+    GeneralEngine                   // Branching engine only
+} EngineKind;
 
-StackElem * Stack;
+// Definition of multi-track transition, as read before its wildcards are expanded
+typedef struct {
+    unsigned int Start;
+    unsigned int End;
+    char Read[MAXTRACKS + 1];       // Read symbol of every track ('*' matches any symbol of that track)
+    char Write[MAXTRACKS + 1];      // Write symbol of every track ('*' keeps read symbol)
+    char MemDirection;
+} TrackTransition;
+
+// Definition of a profiled transition, while a multi-track machine is packed again
+typedef struct {
+    uint32_t From;                  // Index of start state in States
+    char Read;
+    PackedTransition Transition;
+    uint64_t Hits;
+} TransitionCount;
 
-RB_Tree * TM;
+// Definition of multi-tape transition
+typedef struct {
+    uint32_t Start;                 // Index of start state in States (id until machine is packed)
+    uint32_t End;                   // Index of destination state in States (id until machine is packed)
+    char Read[MAXTAPES];            // Read char of every tape
+    char Write[MAXTAPES];           // Write char of every tape
+    unsigned char Move[MAXTAPES];   // Direction where every head moves (MoveKind)
+} TapesTransition;
+
+// Definition of pending branch of multi-tape engine
+typedef struct {
+    uint32_t Trans;                 // Transition to execute
+    size_t TrailLength;             // Nr. of writes on trail when branch was pushed
+    unsigned long int MovesLeft;
+    long Heads[MAXTAPES];
+} TapesBranch;
 
-unsigned long int Moves = 0;
+// Definition of a tape write, as kept on trail to undo it when backtracking
+typedef struct {
+    long Position;
+    unsigned int Tape;
+    char Symbol;                    // Symbol before the write
+} TapesWrite;
 
-int CurrBranchID = 0;
+typedef enum {
+    LifoScheduler,                  // Newest branch first, tape rebuilt from symbol versions
+    MovesScheduler,                 // Branch with most moves left first
+    DistanceScheduler,              // Branch closest to an acceptance state on state graph first
+    PriorityScheduler               // Branch with highest user priority first
+} SchedulerKind;
 
-// Functions
-void InitTM();
+// Definition of pending branch of a scheduler other than LIFO. Branches with same key run newest first
+typedef struct {
+    long Key;                       // Branches with lower key run first
+    uint64_t Sequence;              // Push order
+    StackElem * Elem;
+} HeapEntry;
 
-void ReadInput(char * OutString, int StringSize);
+typedef enum {
+    KeepPolicy,                     // A full probe window keeps its configurations, the new one isn't stored
+    ReplacePolicy                   // A full probe window gives its first slot to the new configuration
+} VisitedPolicy;
 
-TreeNode * SearchNode(RB_Tree *T, TreeNode * x, unsigned int id);
+// Definition of a visited table slot: the whole first fingerprint word, and the tape epoch above 48 bits of the second
+typedef struct {
+    uint64_t Lo;
+    uint64_t Tag;                   // 0 if empty
+} VisitedSlot;
 
-void InOrderTreeWalk(TreeNode * x);
+// Definition of visited configuration table of the branching engine, which runs on a single thread: open addressing
+// with bounded probing. Batch workers are processes, each has its own table
+typedef struct {
+    VisitedSlot * Slots;
+    uint64_t Mask;                  // Nr. of slots - 1
+    uint64_t Epoch;                 // Tag of current tape: slots with other tags are free
+    VisitedPolicy Policy;
+} VisitedTable;
 
-void LeftRotate(RB_Tree * T, TreeNode * x);
+// Definition of visited table statistics
+typedef struct {
+    uint64_t Lookups;
+    uint64_t Hits;                  // Configurations already expanded
+    uint64_t Inserts;
+    uint64_t Probes;                // Slots skipped because taken by other configurations
+    uint64_t Evictions;
+    uint64_t Dropped;               // Configurations not stored as their probe window was full
+} VisitedStats;
+
+typedef struct PENDINGTAPE {
+    char * Input;
+    size_t Length;
+    size_t Position;                // Index of tape in input order
+    int Result;
+} PendingTape;
 
-void RightRotate(RB_Tree * T, TreeNode * x);
+// Definition of a machine of batch mode: its input text, or the file holding it
+typedef struct {
+    char * Text;
+    size_t Length;
+    char * Path;                    // NULL if machine came from standard input
+} BatchMachine;
 
-void TreeInsert(RB_Tree * T, TreeNode * z);
+// Definition of bounded queue of tapes between two pipeline stages, with a single producer and a single consumer.
+// Each index is only used by one side, semaphores order slot accesses
+typedef struct {
+    PendingTape * Slots[RINGSIZE];
+    size_t Head;                    // Next slot read by consumer
+    size_t Tail;                    // Next slot written by producer
+    sem_t Filled;
+    sem_t Free;
+} TapeRing;
 
-void RBInsertFixup(RB_Tree * T, TreeNode * z);
+// Global variables
+FILE * MachineInput = NULL;         // Stream machine and tapes are read from: standard input, or current machine of batch mode
 
-void SetupTuringMachine();
+bool BatchMode = false;             // Input holds many machines, each ended by a BATCHDELIMITER line
 
-TreeNode * AddStateToTM(unsigned int id);
+char * ManifestPath = NULL;         // File listing the machine files of batch mode, one per line
 
-void AddTransitionToTM(unsigned int Start,unsigned int End, char Read, char Write, char MemDirection);
+long BatchWorkers = 0;              // Nr. of worker processes of batch mode (0 for one per core)
 
-void AddTransitionToState(State * TMState, Transition * ToAdd);
+Tape MemoryTape = {{NULL, NULL, 0}, {NULL, NULL, 0}, 0, -1};
 
-void AddTransitionToList(State * TMState, Transition *ToAdd);
+long CurrMemPosition = 0;
 
-Transition * SearchTransition(TransitionList * List, Transition * ToSearch);
+uint64_t TapeHash[2] = {0, 0};      // Zobrist hashes of tape, kept only if Visited is in use
 
-TransitionList * SearchReadCharTransList(State * State, char ToSearch);
+VisitedTable * Visited = NULL;
 
-void SetupAccStatesAndMoves();
+VisitedStats VisitedCounters = {0, 0, 0, 0, 0, 0};
 
-void MoveMemHead(char Direction);
+Symbol * WriteLog = NULL;           // Symbol overwritten by every new symbol version, in write order
 
-Cell * WriteOnTape(Cell * MemCell, char Character);
+size_t WrittenCount = 0;
 
-void StackPush(Transition * Trans);
+size_t WrittenCapacity = 0;
 
-StackElem * StackPop();
+StackElem * Stack;
 
-void RunInputs();
+SchedulerKind Scheduler = LifoScheduler;
 
-void InitStack();
+HeapEntry * Heap = NULL;            // Pending branches of schedulers other than LIFO, as a d-ary heap
 
-int InitTape();
+size_t HeapCount = 0;
 
-int RunTM();
+size_t HeapCapacity = 0;
 
-void FlushMemorySymbols(int BranchID);
+uint64_t HeapSequence = 0;
 
-void FreeMemory();
+Snapshot * LiveBase = NULL;         // Snapshot current tape was loaded from or last taken (NULL if blank tape)
 
-void FreeRightMemory(int BranchID);
+long DirtyMin = __LONG_MAX__;       // Window written since LiveBase
 
-void FreeLeftMemory(int BranchID);
+long DirtyMax = -__LONG_MAX__ - 1;
 
-void CompressionFixup(Cell * MemCell);
+StackElem * LastGroup[256 * 3];     // Branches of last push without a snapshot, as they still share the current tape
 
-void FreeStack();
+size_t LastGroupCount = 0;
 
-void FreeTM();
+char * PriorityPath = NULL;
 
-void FreeTransitions(TreeNode * x);
+RB_Tree * TM;
 
-void FreeNodes(TreeNode * x);
+unsigned long int Moves = 0;
 
-int main() {
-    char InstructionCode[INSTRLENGTH] = "";
-    MemoryTape = malloc(sizeof(Cell));
-    TM = malloc(sizeof(RB_Tree));
+unsigned long int MaxMoves = 0;
 
-    InitTM();
+int CurrBranchID = 0;
 
-    ReadInput(InstructionCode, INSTRLENGTH);
-    if (strcmp(InstructionCode, "tr\n") == 0) {
-        SetupTuringMachine();
-    } else {
-        printf("ERROR: Incorrect input");
-    }
+ResultCache * Cache = NULL;
 
-    FreeMemory();
-    FreeTM();
+uint64_t MachineFingerprint = 0;
 
-    return 0;
-}
+char * TapeBuffer = NULL;
 
-// Read a line of input from stdin and put it into OutString (Mind the \n char!)
-void ReadInput(char * OutString, int StringSize) {
-    OutString[0] = '\0';
-    fgets(OutString, sizeof(char)*StringSize, stdin);
-}
+size_t TapeBufferSize = 0;
 
-// Search function for RB tree
-TreeNode * SearchNode(RB_Tree *T, TreeNode * x, unsigned int id) {
-    if (x == NULL || x == T->nil || (x->StatePtr != NULL && id == x->StatePtr->id)) {
-        return x;
-    }
+FlatTape DetTape = {NULL, 0, 0, 0, -1};
 
-    if (x->StatePtr == NULL) {
-        return T->nil;
-    }
+EngineKind Engine = AutoEngine;
 
-    if (id < x->StatePtr->id) {
-        return SearchNode(T, x->left, id);
-    } else {
-        return SearchNode(T, x->right, id);
-    }
-}
+int (* DeterministicEngine)(const char *, size_t) = NULL;   // Deterministic engine specialized for machine
 
-void InOrderTreeWalk(TreeNode * x) {
-    if (x != TM->nil) {
-        InOrderTreeWalk(x->left);
+uint64_t * DenseNext = NULL;        // Pre-decoded step of every state and symbol code for dense engines: DENSESTEP of
+                                    // destination state, write char and handler (MoveKind, or DENSE* code)
 
-        printf("State nr. %u ; IsAccState: %d\n", x->StatePtr->id, x->StatePtr->IsAcceptanceState);
-        TransitionList * CharElem = x->StatePtr->CharacterList;
-        while (CharElem != NULL) {
-            printf("\tRead [%c]:\n", CharElem->Character);
-            Transition * TransElem = CharElem->Transitions;
+unsigned char SymbolCode[256];      // Code of every symbol on machine alphabet, for dense engines of less than 256 codes
 
-            while (TransElem != NULL) {
-                printf("\t\tWrite: %c ; Move: %c ; ToState: %u\n", TransElem->Write, TransElem->HeadMoveDirection, TransElem->ToState->id);
-                TransElem = TransElem->NextTransition;
-            }
 
-            CharElem = CharElem->Next;
-        }
+State ** States = NULL;
 
-        InOrderTreeWalk(x->right);
-    }
-}
+unsigned int StateCount = 0;
 
-// RB tree left rotation
-void LeftRotate(RB_Tree * T, TreeNode * x) {
-    TreeNode * y = x->right;
-    x->right = y->left;
+PackedTransition * Packed = NULL;
 
-    if (y->left != T->nil) {
-        y->left->p = x;
-    }
+char * KeyPool = NULL;
 
-    y->p = x->p;
+uint32_t * FirstPool = NULL;
 
-    if (x->p == T->nil) {
-        T->root = y;
-    } else if (x == x->p->left) {
-        x->p->left = y;
-    } else {
-        x->p->right = y;
-    }
-    y->left = x;
-    x->p = y;
-}
+const char MoveDirections[] = {'L', 'R', 'S'};
 
-// RB tree right rotation
-void RightRotate(RB_Tree * T, TreeNode * x) {
-    TreeNode * y = x->left;
-    x->left = y->right;
+unsigned int SetWords = 0;          // Words of a state set bitset
 
-    if (y->right != T->nil) {
-        y->right->p = x;
-    }
+EffectGroup * Groups = NULL;
 
-    y->p = x->p;
+uint32_t * GroupFirstPool = NULL;
 
-    if (x->p == T->nil) {
-        T->root = y;
-    } else if (x == x->p->right) {
-        x->p->right = y;
-    } else {
-        x->p->left = y;
-    }
-    y->right = x;
-    x->p = y;
-}
+uint64_t * TargetPool = NULL;
 
-// Insert function for RB tree
-void TreeInsert(RB_Tree * T, TreeNode * z) {
-    TreeNode * y = T->nil;
-    TreeNode * x = T->root;
+PackedTransition * Effects = NULL;  // Transitions of a state and read char, sorted by tape effect
 
-    while (x != T->nil) {
-        y = x;
-        if (z->StatePtr->id < x->StatePtr->id) {
-            x = x->left;
-        } else {
-            x = x->right;
-        }
-    }
+size_t EffectCapacity = 0;
 
-    z->p = y;
+uint64_t * EffectSets = NULL;       // State sets of every tape effect of current branch point
 
-    if (y == T->nil) {
-        T->root = z;        // Empty tree
-    } else if (z->StatePtr->id < y->StatePtr->id) {
-        y->left = z;
-    } else {
-        y->right = z;
-    }
+size_t EffectSetCapacity = 0;
 
-    z->left = T->nil;
-    z->right = T->nil;
-    z->color = red;
+uint32_t EffectSlot[256][3];        // Slot in EffectSets of every write char and move
 
-    RBInsertFixup(T, z);
-}
+uint32_t EffectStamp[256][3];       // Branch point where EffectSlot was set
 
-// Insert-Fixup function for RB tree
-void RBInsertFixup(RB_Tree * T, TreeNode * z) {
-    if (z == T->root) {
-        T->root->color = black;
-    } else {
-        TreeNode * x = z->p;
+uint32_t CurrentStamp = 0;
 
-        if (x->color == red) {
-            if (x == x->p->left) {
-                TreeNode * y = x->p->right;
+char SlotWrite[256 * 3];
 
-                if (y->color == red) {
-                    x->color = black;
-                    y->color = black;
-                    x->p->color = red;
-                    RBInsertFixup(T, x->p);
-                } else {
-                    if (z == x->right) {
-                        z = x;
-                        LeftRotate(T, z);
-                        x = z->p;
-                    }
+unsigned char SlotMove[256 * 3];
 
-                    x->color = black;
-                    x->p->color = red;
-                    RightRotate(T, x->p);
-                }
-            } else {
-                TreeNode * y = x->p->left;
+uint32_t SlotLowest[256 * 3];       // Lowest state index of every slot, while tracing
 
-                if (y->color == red) {
-                    x->color = black;
-                    y->color = black;
-                    x->p->color = red;
-                    RBInsertFixup(T, x->p);
-                } else {
-                    if (z == x->left) {
-                        z = x;
-                        RightRotate(T, z);
-                        x = z->p;
-                    }
+uint32_t SlotStates[256 * 3];       // Nr. of states of every slot while tracing, UINT32_MAX if it must be counted
 
-                    x->color = black;
-                    x->p->color = red;
-                    LeftRotate(T, x->p);
-                }
-            }
-        }
-    }
-}
+uint32_t SlotsPushed[256 * 3];      // Slots pushed by the last move, while tracing
 
-// Initialization of memory tape and TM
-void InitTM() {
-    MemoryTape->Symbols = NULL;
-	MemoryTape->Left = NULL;
-	MemoryTape->Right = NULL;
-	MemoryTape = WriteOnTape(MemoryTape, '_');
+uint64_t * SingleSet = NULL;
 
-    // Init TM nil node
-    TM->nil = malloc(sizeof(TreeNode));
-    TM->nil->p = NULL;
-    TM->nil->left = NULL;
-    TM->nil->right = NULL;
-    TM->nil->color = black;
-    TM->nil->StatePtr = NULL;
+uint64_t * AcceptMask = NULL;       // Bitset of acceptance states
 
-    // Init TM root
-    TM->root = malloc(sizeof(TreeNode));
-    TM->root->p = TM->nil;
-    TM->root->left = TM->nil;
-    TM->root->right = TM->nil;
-    TM->root->color = black;
+uint32_t * DistancePool = NULL;
 
-    // Init state 0
-    TM->root->StatePtr = malloc(sizeof(State));
-    TM->root->StatePtr->CharacterList = NULL;
-    TM->root->StatePtr->IsAcceptanceState = false;
-    TM->root->StatePtr->id = 0;
-}
+size_t FrontierBudget = 0;          // Max bytes of stack elements kept in memory (0 if unlimited)
 
-void SetupTuringMachine() {
-    char StateInput[TRLENGTH];
-    unsigned int StartState, EndState;
-    char ReadSymbol, WriteSymbol, MemDirection;
+size_t FrontierBytes = 0;
 
-    ReadInput(StateInput, TRLENGTH);
+size_t FrontierCount = 0;
 
-    while (strcmp(StateInput, "acc\n") != 0) {
-        sscanf(StateInput, "%u %c %c %c %u\n", &StartState, &ReadSymbol, &WriteSymbol, &MemDirection, &EndState);
-        // Add end state of transition to TM (if it doesn't exists)
-        AddStateToTM(EndState);
-        // Add scanned transition to TM
-        AddTransitionToTM(StartState, EndState, ReadSymbol, WriteSymbol, MemDirection);
+FILE * SpillFile = NULL;
 
-        ReadInput(StateInput, TRLENGTH);
-    }
+off_t * SpillBatches = NULL;        // Offset of every batch in spill file
 
-    SetupAccStatesAndMoves();
-}
+size_t SpillBatchCount = 0;
 
-TreeNode * AddStateToTM(unsigned int id) {
-    TreeNode * NewState = SearchNode(TM, TM->root, id);
-    if (NewState == TM->nil) {
-        NewState = malloc(sizeof(TreeNode));
-        NewState->StatePtr = malloc(sizeof(State));
+size_t SpillBatchCapacity = 0;
 
-        NewState->StatePtr->id = id;
-        NewState->StatePtr->IsAcceptanceState = false;
-        NewState->StatePtr->CharacterList = NULL;
+FILE * TraceFile = NULL;            // Execution trace, if requested
 
-        TreeInsert(TM, NewState);
-        return NewState;
-    } else {
-        return NewState;
-    }
-}
+unsigned char TraceRing[TRACEBUFFER];  // Encoded trace records not yet written in trace file
 
-void AddTransitionToTM(unsigned int Start, unsigned int End, char Read, char Write, char MemDirection) {
-    TreeNode * NewState = AddStateToTM(Start);
-    Transition * NewTransition = malloc(sizeof(Transition));
+size_t TraceRingCount = 0;
 
-    // Init new transition to add
-    NewTransition->Read = Read;
-    NewTransition->Write = Write;
-    NewTransition->ToState = SearchNode(TM, TM->root, End)->StatePtr;
-    NewTransition->HeadMoveDirection = MemDirection;
-    NewTransition->NextTransition = NULL;
+uint64_t TraceRecordCount = 0;      // Nr. of trace records, counting one for every move of run records
 
-    AddTransitionToState(NewState->StatePtr, NewTransition);
+uint64_t TraceLast = TRACENOPARENT; // Trace record of the last executed move
 
-}
+int32_t TraceBranch = 0;            // Branch of the last traced step
 
-void AddTransitionToState(State * TMState, Transition * ToAdd) {
-    // Check if transition already exists
-    if (SearchTransition(TMState->CharacterList, ToAdd) == NULL) {
-        AddTransitionToList(TMState, ToAdd);
-    }
-}
+uint64_t TracePending = 0;          // Moves of branching engine not traced yet, as the record after them replays them
 
+bool TraceReplay = false;           // True if TraceTool replays moves of branching engine from its stack (lifo scheduler)
 
-void AddTransitionToList(State * TMState, Transition *ToAdd) {
-    if (TMState->CharacterList == NULL) {
-        // Allocate memory for a new Character element
-        TransitionList * NewCharacterElement = malloc(sizeof(TransitionList));
+bool TraceMoved = false;            // True if the last move of branching engine waits for its pushes to be traced
 
-        // Initialize new char element
-        NewCharacterElement->Character = ToAdd->Read;
-        NewCharacterElement->Next = NULL;
-        NewCharacterElement->Transitions = ToAdd;
-        TMState->CharacterList = NewCharacterElement;
+bool TracePaged = false;            // True if the last move of branching engine is of a branch paged in from disk
 
-    } else {
-        TransitionList * CharacterElement = TMState->CharacterList;
+uint64_t TraceTapeCount = 0;
 
-        // Find element of CharacterList that matches read character
-        while (CharacterElement->Next != NULL && (CharacterElement->Character != ToAdd->Read)) {
-            CharacterElement = CharacterElement->Next;
-        }
+uint64_t TraceTapeRecord = 0;       // Record nr. of the current tape, whose result record counts the moves after it
 
-        if (CharacterElement->Next != NULL || (CharacterElement->Character == ToAdd->Read)) {
-            // Add [ToAdd] to the head of the transitions list
-            ToAdd->NextTransition = CharacterElement->Transitions;
-            CharacterElement->Transitions = ToAdd;
-        } else {
-            // Allocate memory for a new Character element
-            TransitionList * NewCharacterElement = malloc(sizeof(TransitionList));
+unsigned long int DetMovesLeft = 0; // Moves left to deterministic engine when it stopped, for the run record of its moves
 
-            // Initialize new char element
-            NewCharacterElement->Character = ToAdd->Read;
-            NewCharacterElement->Next = NULL;
-            NewCharacterElement->Transitions = ToAdd;
+char * ProfilePath = NULL;          // Prefix of profile files, if requested
 
-            CharacterElement->Next = NewCharacterElement;
-        }
-    }
-}
+uint64_t * TransitionHits = NULL;   // Nr. of times every packed transition ran, or was expanded into a branch, if profiling
 
-Transition * SearchTransition(TransitionList * List, Transition * ToSearch) {
-    TransitionList * CharacterElement = List;
+uint64_t * StateBacktracks = NULL;  // Nr. of branches every state was restored into by the branching engine, if profiling
 
-    // Find element of CharacterList that matches read character
-    while (CharacterElement != NULL && CharacterElement->Character != ToSearch->Read) {
-        CharacterElement = CharacterElement->Next;
-    }
+unsigned int TrackCount = 1;        // Nr. of tracks of every tape cell
 
-    // CharacterElement points to element that has same Character as ToSearch->Read
-    if (CharacterElement != NULL) {
-        Transition * TransitionElement = CharacterElement->Transitions;
+TrackTransition * TrackTransitions = NULL;
 
-        while (TransitionElement != NULL && (TransitionElement->Write != ToSearch->Write || TransitionElement->ToState != ToSearch->ToState || TransitionElement->HeadMoveDirection != ToSearch->HeadMoveDirection)) {
-            TransitionElement = TransitionElement->NextTransition;
-        }
+size_t TrackTransitionCount = 0;
 
-        return TransitionElement;
+size_t TrackTransitionCapacity = 0;
 
-    } else {
-        return NULL;
-    }
+char TrackSymbols[256 - FIRSTTRACKCODE][MAXTRACKS];  // Symbol tuple of every composite code
 
-}
+unsigned int TrackSymbolCount = 0;
 
-TransitionList * SearchReadCharTransList(State * State, char ToSearch) {
-    TransitionList * CharacterElement = State->CharacterList;
+bool TrackAlphabet[256];            // Symbols first track wildcards match: blank, first track symbols of the machine and
+                                    // input symbols of the tapes run so far
 
-    while (CharacterElement != NULL && CharacterElement->Character != ToSearch) {
-        CharacterElement = CharacterElement->Next;
-    }
+bool TraceMachineChanged = false;   // Machine was packed again since the last traced tape
 
-    return CharacterElement;
-}
+unsigned int TapeCount = 1;         // Nr. of tapes of the machine
 
-void SetupAccStatesAndMoves() {
-    char AccStateStr[(TRLENGTH-7)/2];     // Max nr. of states
-    unsigned int AccState;
-    TreeNode * AccNode;
+TapesTransition * TapesTransitions = NULL;  // Sorted by start state and read chars once machine is packed
 
-    ReadInput(AccStateStr, (TRLENGTH-7)/2);
+size_t TapesTransitionCount = 0;
 
-    while (strcmp(AccStateStr, "max\n") != 0) {
-        sscanf(AccStateStr, "%u\n", &AccState);
+size_t TapesTransitionCapacity = 0;
 
-        AccNode = SearchNode(TM, TM->root, AccState);
-        AccNode->StatePtr->IsAcceptanceState = true;
+uint32_t * TapesFirst = NULL;       // Transitions of state s are TapesTransitions[TapesFirst[s]] to TapesTransitions[TapesFirst[s + 1] - 1]
 
-        ReadInput(AccStateStr, (TRLENGTH-7)/2);
-    }
+FlatTape MultiTapes[MAXTAPES];
 
-    // Setup max moves
-    scanf("%ld\n", &Moves);
+TapesBranch * TapesStack = NULL;
 
-    ReadInput(AccStateStr, 6);
-    if (strcmp(AccStateStr, "run\n") == 0) {
-        RunInputs();
-    }
-}
+size_t TapesStackSize = 0;
 
-// Returns new current state
-Cell * WriteOnTape(Cell * MemCell, char Character) {
-    if (MemCell->Symbols == NULL) {
-		// Can be compressed to the left?
-		if (MemCell->Left != NULL && MemCell->Left->Symbols->Symbol == Character) {
-			MemCell = MemCell->Left;
+size_t TapesStackCapacity = 0;
 
-			if (MemCell->Symbols->BranchID != CurrBranchID) {
-				Symbol * NewMemSymbol = malloc(sizeof(Symbol));
-				NewMemSymbol->Symbol = Character;
-				NewMemSymbol->BranchID = CurrBranchID;
-				NewMemSymbol->SymbolQty = MemCell->Symbols->SymbolQty + 1;
-				NewMemSymbol->CurrSymbol = MemCell->Symbols->CurrSymbol + 1;
+TapesWrite * Trail = NULL;
 
-				NewMemSymbol->Next = MemCell->Symbols;
-				MemCell->Symbols = NewMemSymbol;
-			} else {
-				MemCell->Symbols->SymbolQty++;
-				MemCell->Symbols->CurrSymbol++;
-			}
+size_t TrailLength = 0;
 
-			if (MemCell->Right->Right != NULL) {
-				Cell * CellRightTmp = MemCell->Right;
-				MemCell->Right = MemCell->Right->Right;
-				MemCell->Right->Left = MemCell;
-				free(CellRightTmp);
-			} else {
-				free(MemCell->Right);
-				MemCell->Right = NULL;
-			}
+size_t TrailCapacity = 0;
 
-		// Can be compressed to the right?
-		} else if (MemCell->Right != NULL && MemCell->Right->Symbols->Symbol == Character) {
-			MemCell = MemCell->Right;
-
-			if (MemCell->Symbols->BranchID != CurrBranchID)	{
-				Symbol * NewMemSymbol = malloc(sizeof(Symbol));
-				NewMemSymbol->Symbol = Character;
-				NewMemSymbol->BranchID = CurrBranchID;
-				NewMemSymbol->SymbolQty = MemCell->Symbols->SymbolQty + 1;
-				NewMemSymbol->CurrSymbol = 1;
-
-				NewMemSymbol->Next = MemCell->Symbols;
-				MemCell->Symbols = NewMemSymbol;
-			} else {
-				MemCell->Symbols->SymbolQty++;
-				MemCell->Symbols->CurrSymbol = 1;
-			}
-			
-			if (MemCell->Left->Left != NULL) { 
-				Cell * CellLeftTmp = MemCell->Left;
-				MemCell->Left = MemCell->Left->Left;
-				MemCell->Left->Right = MemCell;
-				free(CellLeftTmp);
-			} else {
-				free(MemCell->Left);
-				MemCell->Left = NULL;
-			}
+uint64_t TapeTimeout = 0;           // Max nanoseconds spent on a single tape (0 if unlimited)
 
-		// If cannot be compressed:
-		} else {
-			MemCell->Symbols = malloc(sizeof(Symbol));
-			MemCell->Symbols->Symbol = Character;
-			MemCell->Symbols->CurrSymbol = 1;
-			MemCell->Symbols->SymbolQty = 1;
-			MemCell->Symbols->Next = NULL;
-			MemCell->Symbols->BranchID = CurrBranchID;
-		}
-    } else {
-		// If memory head inside series of compressed symbols
-		if (MemCell->Symbols->SymbolQty > 1) {
-			if (MemCell->Symbols->Symbol != Character) {
-				Cell * NewCharCell = malloc(sizeof(Cell));
-				NewCharCell->Symbols = malloc(sizeof(Symbol));
-				NewCharCell->Symbols->BranchID = CurrBranchID;
-				NewCharCell->Symbols->Symbol = Character;
-				NewCharCell->Symbols->SymbolQty = 1;
-				NewCharCell->Symbols->CurrSymbol = 1;
-				NewCharCell->Symbols->Next = NULL;
-
-				// If between last and first symbol of series
-				if (MemCell->Symbols->CurrSymbol < MemCell->Symbols->SymbolQty && MemCell->Symbols->CurrSymbol > 1) {
-					Cell * NewRestCell = malloc(sizeof(Cell));
-					NewRestCell->Symbols = malloc(sizeof(Symbol));
-					NewRestCell->Symbols->BranchID = CurrBranchID;
-					NewRestCell->Symbols->Symbol = MemCell->Symbols->Symbol;
-					NewRestCell->Symbols->SymbolQty = MemCell->Symbols->SymbolQty - MemCell->Symbols->CurrSymbol;
-					NewRestCell->Symbols->CurrSymbol = 1;
-					NewRestCell->Symbols->Next = NULL;
-
-					Symbol * UpdatedSymbol = malloc(sizeof(Symbol));
-					UpdatedSymbol->BranchID = CurrBranchID;
-					UpdatedSymbol->Symbol = MemCell->Symbols->Symbol;
-					UpdatedSymbol->SymbolQty = MemCell->Symbols->CurrSymbol - 1;
-					UpdatedSymbol->CurrSymbol = UpdatedSymbol->SymbolQty;
-					
-					if (MemCell->Symbols->BranchID != CurrBranchID) {
-						UpdatedSymbol->Next = MemCell->Symbols;
-						MemCell->Symbols = UpdatedSymbol;
-					} else {
-						UpdatedSymbol->Next = MemCell->Symbols->Next;
-						Symbol * SymbolTmp = MemCell->Symbols;
-						MemCell->Symbols = UpdatedSymbol;
-						free(SymbolTmp);
-					}
-					
-
-					NewRestCell->Right = MemCell->Right;
-					MemCell->Right = NewCharCell;
-					NewCharCell->Right = NewRestCell;
-					NewRestCell->Left = NewCharCell;
-					NewCharCell->Left = MemCell;
-
-					MemCell = NewCharCell;
-
-				// If last symbol of series
-				} else if (MemCell->Symbols->CurrSymbol == MemCell->Symbols->SymbolQty) {
-					Symbol * UpdatedSymbol = malloc(sizeof(Symbol));
-					UpdatedSymbol->BranchID = CurrBranchID;
-					UpdatedSymbol->Symbol = MemCell->Symbols->Symbol;
-					UpdatedSymbol->SymbolQty = MemCell->Symbols->CurrSymbol - 1;
-					UpdatedSymbol->CurrSymbol = UpdatedSymbol->SymbolQty;
-					UpdatedSymbol->Next = MemCell->Symbols;
-					
-					if (MemCell->Symbols->BranchID != CurrBranchID) {
-						MemCell->Symbols = UpdatedSymbol;
-					} else {
-						free(UpdatedSymbol);
-						MemCell->Symbols->SymbolQty--;
-						MemCell->Symbols->CurrSymbol--;
-					}
-					
-					NewCharCell->Right = MemCell->Right;
-					MemCell->Right = NewCharCell;
-					NewCharCell->Left = MemCell;
-					
-					if (NewCharCell->Right != NULL) {
-						NewCharCell->Right->Left = NewCharCell;
-					}
+uint64_t BatchTimeout = 0;          // Max nanoseconds spent on the tapes of a machine (0 if unlimited)
 
-					MemCell = NewCharCell;
-
-				// If first symbol of series
-				} else if (MemCell->Symbols->CurrSymbol == 1) {
-					Cell * NewRestCell = malloc(sizeof(Cell));
-					NewRestCell->Symbols = malloc(sizeof(Symbol));
-					NewRestCell->Symbols->BranchID = CurrBranchID;
-					NewRestCell->Symbols->Symbol = MemCell->Symbols->Symbol;
-					NewRestCell->Symbols->SymbolQty = MemCell->Symbols->SymbolQty - 1;
-					NewRestCell->Symbols->CurrSymbol = 1;
-					NewRestCell->Symbols->Next = NULL;
-					
-					if (MemCell->Symbols->BranchID != CurrBranchID) {
-						// Using only symbol structure of NewCharCell
-						NewCharCell->Symbols->Next = MemCell->Symbols;
-						MemCell->Symbols = NewCharCell->Symbols;				
-					} else {
-						NewCharCell->Symbols->Next = MemCell->Symbols->Next;
-						Symbol * SymbolTmp = MemCell->Symbols;
-						MemCell->Symbols = NewCharCell->Symbols;
-						free(SymbolTmp);
-					}
+uint64_t BatchDeadline = 0;         // Monotonic time when every tape must be done (0 if unlimited)
 
-					free(NewCharCell);
+uint64_t TapeDeadline = 0;          // Monotonic time when current tape times out (0 if unlimited)
 
-					NewRestCell->Right = MemCell->Right;
-					NewRestCell->Left = MemCell;
-					MemCell->Right = NewRestCell;
+unsigned int StepsToCheck = TIMECHECKSTEPS;
 
-					if (NewRestCell->Right != NULL) {
-						NewRestCell->Right->Left = NewRestCell;
-					}
-				}
-			}
+bool Pipelined = false;             // Tapes are read and results written by their own threads
 
-		// Current memory cell has no compressed symbols
-		} else {
-			// Can be compressed to the Left?
-			if (MemCell->Left != NULL && MemCell->Left->Symbols->Symbol == Character) {
-				
-				// If modifying cell is memory tape reference, update
-				if (MemCell == MemoryTape) {
-					MemoryTape = MemCell->Left;
-				}				
-				MemCell = MemCell->Left;
-
-				if (MemCell->Symbols->BranchID != CurrBranchID) {
-					Symbol * NewMemSymbol = malloc(sizeof(Symbol));
-					NewMemSymbol->Symbol = Character;
-					NewMemSymbol->BranchID = CurrBranchID;
-					NewMemSymbol->SymbolQty = MemCell->Symbols->SymbolQty + 1;
-					NewMemSymbol->CurrSymbol = MemCell->Symbols->CurrSymbol + 1;
-
-					NewMemSymbol->Next = MemCell->Symbols;
-					MemCell->Symbols = NewMemSymbol;
-
-				} else {
-					MemCell->Symbols->SymbolQty++;
-					MemCell->Symbols->CurrSymbol++;
-				}
+bool HugePages = false;             // Machine image, tapes and write log are mapped on 2 MB pages
 
-				if (MemCell->Right->Symbols->BranchID == CurrBranchID) {
-					Symbol * SymbolTmp = MemCell->Right->Symbols;
-					MemCell->Right->Symbols = MemCell->Right->Symbols->Next;
-					free(SymbolTmp);
-				}
-				if (MemCell->Right->Symbols == NULL) {
-					Cell * MemTmp = MemCell->Right;
-					MemCell->Right = MemCell->Right->Right;
+uint64_t HugeMappings[2] = {0, 0};  // Nr. of large blocks mapped with explicit huge pages, and with transparent ones
 
-					if (MemCell->Right != NULL) {
-						MemCell->Right->Left = MemCell;
-					}
+int PerfCounters[2] = {-1, -1};     // dTLB load misses and cycles counters, if -H was given
 
-					free(MemTmp);
-				} else {
-					// Use of dummy symbol that has qty = 0 so that it is ignored while running.
-					Symbol * DummySymbol = malloc(sizeof(Symbol));
-					DummySymbol->BranchID = CurrBranchID;
-					DummySymbol->Symbol = '-';
-					DummySymbol->SymbolQty = 0;
-					DummySymbol->CurrSymbol = 0;
-					DummySymbol->Next = MemCell->Right->Symbols;
-
-					MemCell->Right->Symbols = DummySymbol;
-				}
-			// Can be compressed to the Right?
-			} else if (MemCell->Right != NULL && MemCell->Right->Symbols->Symbol == Character) {
-				
-				// If modifying cell is memory tape reference, update
-				if (MemCell == MemoryTape) {
-					MemoryTape = MemCell->Right;
-				}
-				MemCell = MemCell->Right;
+TapeRing ReadRing;                  // Tapes from reader stage to simulator stage
 
-				if (MemCell->Symbols->BranchID != CurrBranchID) {
-					Symbol * NewMemSymbol = malloc(sizeof(Symbol));
-					NewMemSymbol->Symbol = Character;
-					NewMemSymbol->BranchID = CurrBranchID;
-					NewMemSymbol->SymbolQty = MemCell->Symbols->SymbolQty + 1;
-					NewMemSymbol->CurrSymbol = 1;
+TapeRing WriteRing;                 // Results from simulator stage to writer stage
 
-					NewMemSymbol->Next = MemCell->Symbols;
-					MemCell->Symbols = NewMemSymbol;
+// Functions
+void InitTM();
 
-				} else {
-					MemCell->Symbols->SymbolQty++;
-					MemCell->Symbols->CurrSymbol = 1;
-				}
+BatchMachine * LoadBatch(size_t * Count);
 
-				if (MemCell->Left->Symbols->BranchID == CurrBranchID) {
-					Symbol * SymbolTmp = MemCell->Left->Symbols;
-					MemCell->Left->Symbols = MemCell->Left->Symbols->Next;
-					free(SymbolTmp);
-				}
-				if (MemCell->Left->Symbols == NULL) {
-					Cell * MemTmp = MemCell->Left;
-					MemCell->Left = MemCell->Left->Left;
+void RunBatch(BatchMachine * Machines, size_t Count);
 
-					if (MemCell->Left != NULL) {
-						MemCell->Left->Right = MemCell;
-					}
+void RunBatchMachine(const BatchMachine * Machine);
 
-					free(MemTmp);
-				} else {
-					// Use of dummy symbol that has qty = 0 so that it is ignored while running.
-					Symbol * DummySymbol = malloc(sizeof(Symbol));
-					DummySymbol->BranchID = CurrBranchID;
-					DummySymbol->Symbol = '-';
-					DummySymbol->SymbolQty = 0;
-					DummySymbol->CurrSymbol = 0;
-					DummySymbol->Next = MemCell->Left->Symbols;
-
-					MemCell->Left->Symbols = DummySymbol;
-				}
+void ReleaseMachine();
 
-			// Cannot be compressed
-			} else {
-				if (MemCell->Symbols->BranchID != CurrBranchID) {
-					Symbol * NewMemSymbol = malloc(sizeof(Symbol));
-					NewMemSymbol->Symbol = Character;
-					NewMemSymbol->BranchID = CurrBranchID;
-					NewMemSymbol->CurrSymbol = 1;
-					NewMemSymbol->SymbolQty = 1;
-
-					NewMemSymbol->Next = MemCell->Symbols;
-					MemCell->Symbols = NewMemSymbol;
-				}
-				else {
-					MemCell->Symbols->Symbol = Character;
-					MemCell->Symbols->CurrSymbol = 1;
-					MemCell->Symbols->SymbolQty = 1;
-				}
-			}
-		}
-    }
-	return MemCell;
-}
+bool ReadInput(char * OutString, int StringSize);
 
-void MoveMemHead(char Direction) {
-    if (Direction == 'L') {
-        if (CurrMemPosition->Left != NULL) {
-			// Dummy cell
-			if (CurrMemPosition->Left->Symbols->SymbolQty == 0) {
-				CurrMemPosition = CurrMemPosition->Left;
-				MoveMemHead('L');
-				return;
-			}
+TreeNode * SearchNode(RB_Tree *T, TreeNode * x, unsigned int id);
 
-			// Not dummy
-			if (CurrMemPosition->Left->Symbols->BranchID <= CurrBranchID && CurrMemPosition->Symbols->CurrSymbol <= 1) {
-				CurrMemPosition = CurrMemPosition->Left;
-			} else if (CurrMemPosition->Left->Symbols->BranchID > CurrBranchID && CurrMemPosition->Symbols->CurrSymbol <= 1) {
-				CurrMemPosition = CurrMemPosition->Left;
-				MoveMemHead('L');
-			} else if (CurrMemPosition->Symbols->CurrSymbol > 1) {
-				CurrMemPosition->Symbols->CurrSymbol--;
-			}
-        } else {
-			if (CurrMemPosition->Symbols->CurrSymbol > 1) {
-				CurrMemPosition->Symbols->CurrSymbol--;
-			} else {
-				CurrMemPosition->Left = malloc(sizeof(Cell));
-				CurrMemPosition->Left->Symbols = NULL;
-				CurrMemPosition->Left->Left = NULL;
-				CurrMemPosition->Left->Right = CurrMemPosition;
-				CurrMemPosition = WriteOnTape(CurrMemPosition->Left, '_');
+void InOrderTreeWalk(TreeNode * x);
 
-			}
-        }
-    } else if (Direction == 'R') {
-        if (CurrMemPosition->Right != NULL) {
-			// Dummy cell
-			if (CurrMemPosition->Right->Symbols->SymbolQty == 0) {
-				CurrMemPosition = CurrMemPosition->Right;
-				MoveMemHead('R');
-				return;
-			}
+void LeftRotate(RB_Tree * T, TreeNode * x);
 
-			if (CurrMemPosition->Right->Symbols->BranchID <= CurrBranchID && CurrMemPosition->Symbols->CurrSymbol >= CurrMemPosition->Symbols->SymbolQty) {
-				CurrMemPosition = CurrMemPosition->Right;
-			} else if (CurrMemPosition->Right->Symbols->BranchID > CurrBranchID && CurrMemPosition->Symbols->CurrSymbol >= CurrMemPosition->Symbols->SymbolQty) {
-				CurrMemPosition = CurrMemPosition->Right;
-				MoveMemHead('R');
-			} else if (CurrMemPosition->Symbols->CurrSymbol < CurrMemPosition->Symbols->SymbolQty) {
-				CurrMemPosition->Symbols->CurrSymbol++;
-			}
-        } else {
-			if (CurrMemPosition->Symbols->CurrSymbol < CurrMemPosition->Symbols->SymbolQty) {
-				CurrMemPosition->Symbols->CurrSymbol++;
-			} else {
-				CurrMemPosition->Right = malloc(sizeof(Cell));
-				CurrMemPosition->Right->Symbols = NULL;
-				CurrMemPosition->Right->Right = NULL;
-				CurrMemPosition->Right->Left = CurrMemPosition;
-				CurrMemPosition = WriteOnTape(CurrMemPosition->Right, '_');
-				
-			}
-        }
-    } else if (Direction == 'S') {
+void RightRotate(RB_Tree * T, TreeNode * x);
 
-    } else {
-        printf("Invalid direction!\n");
-    }
-}
+void TreeInsert(RB_Tree * T, TreeNode * z);
 
-void StackPush(Transition * Trans) {
-    StackElem * NewElem = malloc(sizeof(StackElem));
-    NewElem->Next = Stack;
-    NewElem->MemPositionBuffer = CurrMemPosition;
-	NewElem->CurrSymbolBuffer = CurrMemPosition->Symbols->CurrSymbol;
-    NewElem->BranchID = CurrBranchID;
-    NewElem->MovesBuffer = Moves;
-    NewElem->Trans = Trans;
+void RBInsertFixup(RB_Tree * T, TreeNode * z);
 
-    Stack = NewElem;
-}
+bool SetupTuringMachine();
 
-StackElem * StackPop() {
-    if (Stack != NULL) {
-        StackElem * PoppedElem = Stack;
-        Stack = Stack->Next;
-        return PoppedElem;
-    } else return NULL;
-}
+TreeNode * AddStateToTM(unsigned int id);
 
-void RunInputs() {
-	// Debugging TM setting phase
-    /*TreeNode * DebugTree = TM->root;
-    InOrderTreeWalk(DebugTree);
-    printf("Max moves = %d\n", Moves);*/
+void AddTransitionToTM(unsigned int Start,unsigned int End, char Read, char Write, char MemDirection);
 
-    int Result;
-    unsigned int MovesTmp = Moves;
+void AddTransitionToState(State * TMState, Transition * ToAdd);
 
-    while (InitTape() != 0) {
-        InitStack();
+void AddTrackTransition(unsigned int Start, unsigned int End, const char * Read, const char * Write, char MemDirection);
 
-        Result = RunTM();
+int CompareTrackTransitions(const void * a, const void * b);
 
-        if (Result == 1 || Result == 0) {
-            printf("%d\n", Result);
-        } else if (Result == 2) {
-            printf("%c\n", 'U');
-        }
+void ExpandTrackTransitions();
 
-        FreeStack();
+void ExpandTrackInputs(const char * Input, size_t Length);
 
-        CurrBranchID = 0;
-        Moves = MovesTmp;
-		FlushMemorySymbols(-1);
+void RepackTrackMachine();
 
-        MemoryTape->Right = NULL;
-        MemoryTape->Left = NULL;
-        MemoryTape->Symbols = NULL;
-		MemoryTape = WriteOnTape(MemoryTape, '_');
-    }
-}
+char InternTrackSymbol(const char * Tuple);
 
-void InitStack() {
-    char FirstSymbol = MemoryTape->Symbols->Symbol;
-    TransitionList * TransTmp = SearchReadCharTransList(SearchNode(TM, TM->root, 0)->StatePtr, FirstSymbol);
+void AddTapesTransition(unsigned int Start, unsigned int End, const char * Read, const char * Write, const char * Moves);
 
-	if (TransTmp != NULL)
-	{
-		Transition * CurrTransTmp = TransTmp->Transitions;
+void PackTapesMachine();
 
-		CurrBranchID++;
+int CompareTapesTransitions(const void * a, const void * b);
 
-		while (CurrTransTmp != NULL)
-		{
-			StackPush(CurrTransTmp);
-			CurrTransTmp = CurrTransTmp->NextTransition;
-		}
+void FreeTapesMachine();
 
-		if (TransTmp->Transitions->NextTransition == NULL)
-		{
-			CurrBranchID--;
-		}
-	}    
-}
+int RunMultiTape(const char * Input, size_t Length);
 
-// Returns 0 if there are no input left
-int InitTape() {
-    int InputSymbol;
-    Cell * MemoryTapeTmp = MemoryTape;
+void PushTapesBranches(uint32_t First, uint32_t Last, const long * Heads, unsigned long int MovesLeft);
 
-    InputSymbol = getchar();
-    if (InputSymbol == EOF) {
-        return 0;
-    }
+void AddTransitionToList(State * TMState, Transition *ToAdd);
 
-    do {
-        MemoryTapeTmp = WriteOnTape(MemoryTapeTmp, (char) InputSymbol);
+Transition * SearchTransition(TransitionList * List, Transition * ToSearch);
 
-        if (MemoryTapeTmp->Right != NULL) {
-            MemoryTapeTmp = MemoryTapeTmp->Right;
-        } else {
-            MemoryTapeTmp->Right = malloc(sizeof(Cell));
-            MemoryTapeTmp->Right->Symbols = NULL;
-			MemoryTapeTmp->Right->Right = NULL;
-			MemoryTapeTmp->Right->Left = MemoryTapeTmp;
-			MemoryTapeTmp = WriteOnTape(MemoryTapeTmp->Right, '_');
+int SearchReadSymbol(const State * CurrState, char ToSearch);
 
-        }
-    } while ((InputSymbol = getchar()) != '\n' && InputSymbol != EOF);
+void PackMachine();
 
-	CurrMemPosition = MemoryTapeTmp->Left;
-	while (CurrMemPosition != MemoryTape || CurrMemPosition->Symbols->CurrSymbol > 1) {
-		MoveMemHead('L');
-	}
+void CountPackedStates(TreeNode * x, size_t * KeyTotal, size_t * TransTotal);
 
-    return 1;
-};
+void FillPackedStates(TreeNode * x, size_t * KeyTotal, size_t * TransTotal);
 
-/*int RunTM(State * CurrentState) {     // Recursive function for RunTM. Delete if not necessary
-    if(Moves <= 0) {
-        return 2;
-    }
+void FreePackedMachine();
 
-    if (CurrentState->IsAcceptanceState == true) {
-        return 1;
-    }
+uint32_t PackedTransitionCount();
 
-    char ReadMem = CurrMemPosition->Symbol;
-    TransitionList * TransList = SearchReadCharTransList(CurrentState, ReadMem);
+bool SetupAccStatesAndMoves();
 
-    if (TransList == NULL) {
-        return 0;
-    }
+void MoveMemHead(char Direction);
 
-    Transition * CurrentTransition = TransList->Transitions;
-    Cell * CurrTmp = CurrMemPosition;
-    char SymbolTmp = CurrMemPosition->Symbol;
-	int ExecResult = 0;
+void WriteOnTape(long Position, char Character);
 
-    while (CurrentTransition != NULL) {
-		// Execute transition
-        CurrMemPosition->Symbol = CurrentTransition->Write;
-        MoveMemHead(CurrentTransition->HeadMoveDirection);
-        Moves--;
+Cell * TapeCell(long Position);
 
-        ExecResult = RunTM(CurrentTransition->ToState);
-		
-		Moves++;
-		CurrMemPosition = CurrTmp;
-		CurrMemPosition->Symbol = SymbolTmp;
+char * TapeSymbol(long Position);
 
-        if (ExecResult == 1) {
-            return ExecResult;
-		}
+void TapeReserve(long Position);
 
-        CurrentTransition = CurrentTransition->NextTransition;
-    }
+void HalfTapeGrow(HalfTape * T, long Index);
 
-    Moves++;
-    CurrMemPosition = CurrTmp;
-    CurrMemPosition->Symbol = SymbolTmp;
-    return ExecResult;
-}*/
+void StackPush(char Write, unsigned char Move, const uint64_t * Targets, const StackElem * Trace, Snapshot * Snap);
 
-int RunTM() {       // Iterative version of RunTM
-    State * CurrentState = SearchNode(TM, TM->root, 0)->StatePtr;
-    StackElem * CurrStack;
-    char Input;
-    int AreMovesOver = 0;
-	
-	CurrStack = StackPop();
+long BranchKey(const StackElem * Elem);
 
-	if (CurrStack == NULL)
-	{
-		return 0;
-	}
+bool HeapBefore(const HeapEntry * a, const HeapEntry * b);
 
-    do {
-        if (CurrStack->BranchID > CurrBranchID) {
-            Transition * CurrTransition = CurrStack->Trans;
+void HeapPush(StackElem * Elem);
 
-            // Exec transition
-			CurrMemPosition = WriteOnTape(CurrMemPosition, CurrTransition->Write);
-            MoveMemHead(CurrTransition->HeadMoveDirection);
-            CurrentState = CurrTransition->ToState;
-            Moves--;
+StackElem * HeapPop();
 
-        } else if (CurrStack->BranchID <= CurrBranchID){
-            Transition * CurrTransition = CurrStack->Trans;
+void SealLastGroup(const StackElem * Except);
 
-            FlushMemorySymbols(CurrStack->BranchID - 1);
-            CurrMemPosition = CurrStack->MemPositionBuffer;
-			CompressionFixup(CurrMemPosition);
-			CurrMemPosition->Symbols->CurrSymbol = CurrStack->CurrSymbolBuffer;
-			Moves = CurrStack->MovesBuffer;
-			CurrBranchID = CurrStack->BranchID;
+void ComputeGoalDistances();
 
-            // Exec transition
-			CurrMemPosition = WriteOnTape(CurrMemPosition, CurrTransition->Write);
-            MoveMemHead(CurrTransition->HeadMoveDirection);
-            CurrentState = CurrTransition->ToState;
-            Moves--;
+uint32_t SetGoalDistance(const uint64_t * Set);
 
-		}
+bool IsHopeless(const uint64_t * Set, unsigned long int MovesLeft, int AreMovesOver);
 
-		// Update stack with new transitions
-		Input = CurrMemPosition->Symbols->Symbol;
-		TransitionList * TransList = SearchReadCharTransList(CurrentState, Input);
+void LoadPriorities(const char * Path);
 
-		if (TransList != NULL && Moves > 0)
-		{
-			Transition * TransitionTemp = TransList->Transitions;
+void ProfileCreate();
 
-			CurrBranchID++;
-			int AddedTrans = 0;
+void ProfileBacktrack(const uint64_t * Set);
 
-			while (TransitionTemp != NULL)
-			{
-				if (!(TransitionTemp->HeadMoveDirection == 'S' && TransitionTemp->Read == TransitionTemp->Write && TransitionTemp->ToState == CurrentState)) {
-					StackPush(TransitionTemp);
-					AddedTrans++;
-					TransitionTemp = TransitionTemp->NextTransition;
-				}
-				else {
-					AreMovesOver = 2;
-				}
-				
-			}
+void ProfileWrite();
 
-			if (AddedTrans <= 1) {
-				CurrBranchID--;
-			}
-		}
+void ProfileSymbol(char Symbol, char * Out);
 
-		if (Moves <= 0) {			
-			AreMovesOver = 2;
-		} else if (CurrentState->IsAcceptanceState == true)	{
-			free(CurrStack);
-			return 1;
-		}
+size_t StackElemBytes(const StackElem * Elem);
 
-        free(CurrStack);
-		CurrStack = StackPop();		
-    } while (CurrStack != NULL);
+StackElem * StackPop();
 
-    return AreMovesOver;
-}
+void RunInputs();
 
-// BranchID = -1 if complete symbols
-void FlushMemorySymbols(int BranchID) {
-    // Flush right side
-    FreeRightMemory(BranchID);
+void RunScheduledInputs();
 
-    // Flush left side
-    FreeLeftMemory(BranchID);
+int RunInput(const char * Input, size_t Length);
 
-	// Flush center
-	if (MemoryTape->Symbols != NULL && MemoryTape->Symbols->BranchID > BranchID)
-	{
-		Symbol *CurrSymbol = MemoryTape->Symbols;
+void PrintResult(int Result);
 
-		while (CurrSymbol != NULL && CurrSymbol->BranchID > BranchID)
-		{
-			Symbol *SymbolTmp = CurrSymbol;
-			CurrSymbol = CurrSymbol->Next;
+int CompareTapeLength(const void * a, const void * b);
 
-			free(SymbolTmp);
-		}
+void RunPipelinedInputs();
 
-		MemoryTape->Symbols = CurrSymbol;
-	}
-}
+void * ReaderStage(void * Arg);
 
-void FreeMemory() {
-    FlushMemorySymbols(-1);
-    free(MemoryTape);
-}
+void * WriterStage(void * Arg);
 
-void FreeRightMemory(int BranchID) {
-    // Flush right side
-    // Positioning temp head to rightmost position
-    Cell * MemoryTapeTmp = MemoryTape;
-    while (MemoryTapeTmp->Right != NULL) {
-        MemoryTapeTmp = MemoryTapeTmp->Right;
-    }
+void RingInit(TapeRing * Ring);
 
-    while (MemoryTapeTmp != MemoryTape) {
-        Cell * LeftMemTmp = MemoryTapeTmp->Left;
+void RingPush(TapeRing * Ring, PendingTape * Tape);
 
-        if (MemoryTapeTmp->Symbols != NULL && MemoryTapeTmp->Symbols->BranchID > BranchID) {
-            Symbol * CurrSymbol = MemoryTapeTmp->Symbols;
+PendingTape * RingPop(TapeRing * Ring);
 
-            while (CurrSymbol != NULL && CurrSymbol->BranchID > BranchID) {
-                Symbol * SymbolTmp = CurrSymbol;
-                CurrSymbol = CurrSymbol->Next;
+void RingDestroy(TapeRing * Ring);
 
-                free(SymbolTmp);
-            }
+uint64_t Now();
 
-            MemoryTapeTmp->Symbols = CurrSymbol;
-            if (MemoryTapeTmp->Symbols == NULL) {
-                MemoryTapeTmp->Left->Right = MemoryTapeTmp->Right;
+bool TimedOut();
 
-				if (MemoryTapeTmp->Right != NULL) {
-					MemoryTapeTmp->Right->Left = MemoryTapeTmp->Left;
-				}
+void InitStack();
 
-                free(MemoryTapeTmp);
-            }
-        }
-        MemoryTapeTmp = LeftMemTmp;
-    }
-}
+size_t ReadTape();
 
-void FreeLeftMemory(int BranchID) {
-    // Flush left side
-    // Moving temp head to leftmost position
-    Cell * MemoryTapeTmp = MemoryTape;
-    while (MemoryTapeTmp->Left != NULL) {
-        MemoryTapeTmp = MemoryTapeTmp->Left;
-    }
+void InitTape(const char * Input, size_t Length);
 
-    while (MemoryTapeTmp != MemoryTape) {
-		Cell * RightMemTmp = MemoryTapeTmp->Right;
+void LoadTape(const char * Input, size_t Length, long Start);
 
-        if (MemoryTapeTmp->Symbols != NULL && MemoryTapeTmp->Symbols->BranchID > BranchID) {
-            Symbol * CurrSymbol = MemoryTapeTmp->Symbols;
+int RunTM(int AreMovesOver);
 
-            while (CurrSymbol != NULL && CurrSymbol->BranchID > BranchID) {
-                Symbol * SymbolTmp = CurrSymbol;
-                CurrSymbol = CurrSymbol->Next;
+bool PushTransitions(const uint64_t * Set, char Read, int * AreMovesOver, bool SkipLoops);
 
-                free(SymbolTmp);
-            }
+bool PushState(uint32_t StateIndex, char Read, int * AreMovesOver, bool SkipLoops);
 
-			MemoryTapeTmp->Symbols = CurrSymbol;
-			if (MemoryTapeTmp->Symbols == NULL) {
-				MemoryTapeTmp->Right->Left = MemoryTapeTmp->Left;
+void GroupMachine(size_t TransTotal);
 
-				if (MemoryTapeTmp->Left != NULL) {
-					MemoryTapeTmp->Left->Right = MemoryTapeTmp->Right;
-				}
+void ComputeAcceptance();
 
-				free(MemoryTapeTmp);
-			}
-        }
+uint32_t StateAcceptDistance(uint32_t StateIndex, char Read);
 
-		MemoryTapeTmp = RightMemTmp;
-    }
-}
+void SetUnion(uint64_t * To, const uint64_t * From);
 
-// Fixes CurrSymbol variable for left and right half of memory
-void CompressionFixup(Cell * MemCell) {
-	Cell * MemCellTmp = MemCell;
+uint32_t SetCount(const uint64_t * Set);
 
-	while (MemCellTmp->Right != NULL) {
-		MemCellTmp = MemCellTmp->Right;
-		MemCellTmp->Symbols->CurrSymbol = 1;
+bool SetIsEmpty(const uint64_t * Set);
+
+int CompareEffects(const void * a, const void * b);
+
+int SimulateTape(const char * Input, size_t Length);
+
+int RunGeneral(const char * Input, size_t Length);
+
+int RunDeterministic(const char * Input, size_t Length);
+
+void SelectEngine();
+
+int RunDense4(const char * Input, size_t Length);
+
+int RunDense16(const char * Input, size_t Length);
+
+int RunDense256(const char * Input, size_t Length);
+
+int ResumeGeneral(State * CurrentState, int Key, long Head);
+
+void ResetMemory();
+
+void * LargeAlloc(size_t Size);
+
+void * LargeRealloc(void * Block, size_t Size);
+
+void LargeAllocFailed(size_t Size);
+
+void LargeFree(void * Block);
+
+void PerfStart();
+
+void PerfReport();
+
+void FlatTapeLoad(FlatTape * T, const char * Input, size_t Length);
+
+void FlatTapeGrow(FlatTape * T, long Position);
+
+void FlushMemorySymbols(int BranchID);
+
+void FreeMemory();
+
+void FreeStack();
+
+void SpillFrontier();
+
+void PageInFrontier();
+
+void SpillWrite(const void * Data, size_t Size, size_t Count);
+
+void SpillRead(void * Data, size_t Size, size_t Count);
+
+void SpillFailed(const char * Action);
+
+Snapshot * CaptureSnapshot(int Version, long From, long To, long Head);
+
+Snapshot * CaptureDelta(long Head);
+
+void WriteSpilledElem(const StackElem * Elem, const StackElem * Previous);
+
+void LoadSnapshot(const Snapshot * Snap);
+
+void ReleaseSnapshot(Snapshot * Snap);
+
+size_t SnapshotBytes(const Snapshot * Snap);
+
+void DiscardSpilled();
+
+void ResetTape();
+
+size_t ParseSize(const char * Size);
+
+void FreeTM();
+
+void FreeTransitions(TreeNode * x);
+
+void FreeNodes(TreeNode * x);
+
+int CompareTransitions(const void * a, const void * b);
+
+void HashMachineStates(TreeNode * x, uint64_t * Hash);
+
+void ComputeMachineFingerprint();
+
+void TraceWriteHeader();
+
+void TraceWriteTransitions();
+
+void TraceTapeStart(const char * Input, size_t Length);
+
+void TraceDeterministicRun();
+
+uint64_t TraceAppend(uint8_t Kind, char Read, char Write, unsigned char Move, uint32_t StateId, uint32_t StateCount, uint64_t Parent);
+
+uint64_t TraceMove(char Read, const StackElem * Elem);
+
+void TraceContinued();
+
+void TraceReplayPushes(const uint32_t * Slots, uint32_t Count, bool All, bool SkipLoops);
+
+void TraceDropped();
+
+void TracePutNumber(uint64_t Number);
+
+void TraceFlush();
+
+uint64_t Mix64(uint64_t x);
+
+void TapeHashCell(long Position, char Old, char New);
+
+bool VisitedSeen(const uint64_t * Set);
+
+VisitedTable * VisitedCreate(size_t Capacity, VisitedPolicy Policy);
+
+bool VisitedInsert(VisitedTable * Table, uint64_t Lo, uint64_t Hi, VisitedStats * Stats);
+
+void VisitedNextTape(VisitedTable * Table);
+
+void VisitedReport(const VisitedTable * Table, const VisitedStats * Stats);
+
+void VisitedFree(VisitedTable * Table);
+
+uint64_t HashBytes(uint64_t Hash, const void * Data, size_t Size);
+
+uint64_t HashWords(const void * Data, size_t Size);
+
+ResultCache * CacheCreate(size_t Capacity, const char * DiskPath);
+
+void CacheLoadDisk(ResultCache * C, const char * DiskPath);
+
+size_t CacheBucket(const ResultCache * C, const CacheRecord * Key);
+
+bool CacheKeyEquals(const CacheRecord * a, const CacheRecord * b);
+
+bool CacheLookup(ResultCache * C, CacheRecord * Key);
+
+void CacheInsert(ResultCache * C, const CacheRecord * Record);
+
+void CacheStore(ResultCache * C, const CacheRecord * Record);
+
+void CacheFree(ResultCache * C);
+
+int main(int argc, char ** argv) {
+    char InstructionCode[INSTRLENGTH] = "";
+    size_t CacheCapacity = CACHECAPACITY;
+    char * CachePath = NULL;
+    char * PolicyName;
+    VisitedPolicy Policy;
+    int Option;
+
+    BatchMachine * Machines;
+    size_t MachineCount, i;
+
+    MachineInput = stdin;
+
+    while ((Option = getopt(argc, argv, "bc:C:d:e:H:jk:m:M:n:p:P:r:s:t:V:w:")) != -1) {
+        switch (Option) {
+            case 'b':
+                BatchMode = true;
+                break;
+            case 'c':
+                CachePath = optarg;
+                break;
+            case 'C':
+                CacheCapacity = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                if (strcmp(optarg, "general") == 0) {
+                    Engine = GeneralEngine;
+                } else if (strcmp(optarg, "auto") == 0) {
+                    Engine = AutoEngine;
+                } else {
+                    fprintf(stderr, "ERROR: Unknown engine %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                BatchTimeout = strtoull(optarg, NULL, 10) * 1000000ULL;
+                break;
+            case 'H':
+                if (strcmp(optarg, "huge") == 0) {
+                    HugePages = true;
+                } else if (strcmp(optarg, "small") != 0) {
+                    fprintf(stderr, "ERROR: Unknown page size %s\n", optarg);
+                    return 1;
+                }
+                PerfStart();
+                break;
+            case 'j':
+                Pipelined = true;
+                break;
+            case 'k':
+                TrackCount = (unsigned int) strtoul(optarg, NULL, 10);
+                if (TrackCount < 1 || TrackCount > MAXTRACKS) {
+                    fprintf(stderr, "ERROR: Nr. of tracks must be between 1 and %d\n", MAXTRACKS);
+                    return 1;
+                }
+                break;
+            case 'm':
+                FrontierBudget = ParseSize(optarg);
+                break;
+            case 'M':
+                ManifestPath = optarg;
+                BatchMode = true;
+                break;
+            case 'n':
+                TapeCount = (unsigned int) strtoul(optarg, NULL, 10);
+                if (TapeCount < 1 || TapeCount > MAXTAPES) {
+                    fprintf(stderr, "ERROR: Nr. of tapes must be between 1 and %d\n", MAXTAPES);
+                    return 1;
+                }
+                break;
+            case 'p':
+                ProfilePath = optarg;
+                break;
+            case 'P':
+                PriorityPath = optarg;
+                Scheduler = PriorityScheduler;
+                break;
+            case 's':
+                if (strcmp(optarg, "lifo") == 0) {
+                    Scheduler = LifoScheduler;
+                } else if (strcmp(optarg, "moves") == 0) {
+                    Scheduler = MovesScheduler;
+                } else if (strcmp(optarg, "dist") == 0) {
+                    Scheduler = DistanceScheduler;
+                } else if (strcmp(optarg, "prio") == 0) {
+                    Scheduler = PriorityScheduler;
+                } else {
+                    fprintf(stderr, "ERROR: Unknown scheduler %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                TraceFile = fopen(optarg, "wb");
+                if (TraceFile == NULL) {
+                    fprintf(stderr, "ERROR: Cannot open trace file %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                TapeTimeout = strtoull(optarg, NULL, 10) * 1000000ULL;
+                break;
+            case 'w':
+                BatchWorkers = strtol(optarg, NULL, 10);
+                break;
+            case 'V':
+                PolicyName = strchr(optarg, ',');
+                if (PolicyName == NULL || strcmp(PolicyName, ",keep") == 0) {
+                    Policy = KeepPolicy;
+                } else if (strcmp(PolicyName, ",replace") == 0) {
+                    Policy = ReplacePolicy;
+                } else {
+                    fprintf(stderr, "ERROR: Unknown replacement policy %s\n", PolicyName + 1);
+                    return 1;
+                }
+                VisitedFree(Visited);
+                Visited = VisitedCreate(ParseSize(optarg), Policy);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-b] [-c cachefile] [-C cachecapacity] [-d batchms] [-e auto|general] [-H huge|small] [-j] [-k tracks] [-m frontierbudget] [-M manifest] [-n tapes] [-p profileprefix] [-P priorityfile] [-r tracefile] [-s lifo|moves|dist|prio] [-t tapems] [-V entries[,keep|replace]] [-w workers]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (TrackCount > 1 && TapeCount > 1) {
+        fprintf(stderr, "ERROR: Multi-track and multi-tape modes cannot be combined\n");
+        return 1;
+    }
+    // Heap schedulers keep pending branches in a heap, that is never spilled
+    if (FrontierBudget > 0 && Scheduler != LifoScheduler) {
+        fprintf(stderr, "ERROR: Frontier budget only applies to the lifo scheduler\n");
+        return 1;
+    }
+    if (BatchTimeout > 0 && Pipelined == true) {
+        fprintf(stderr, "ERROR: Batch deadline needs every tape read before running, it cannot be used with the pipeline\n");
+        return 1;
+    }
+    if (BatchMode == true && (TraceFile != NULL || ProfilePath != NULL)) {
+        fprintf(stderr, "ERROR: Traces and profiles are for a single machine, they cannot be used in batch mode\n");
+        return 1;
+    }
+
+    if (CacheCapacity > 0 || CachePath != NULL) {
+        Cache = CacheCreate(CacheCapacity, CachePath);
+    }
+
+    if (BatchMode == true) {
+        Machines = LoadBatch(&MachineCount);
+        RunBatch(Machines, MachineCount);
+        for (i = 0; i < MachineCount; i++) {
+            free(Machines[i].Text);
+            free(Machines[i].Path);
+        }
+        free(Machines);
+    } else {
+        TM = malloc(sizeof(RB_Tree));
+
+        InitTM();
+
+        ReadInput(InstructionCode, INSTRLENGTH);
+        if (strcmp(InstructionCode, "tr\n") != 0 || SetupTuringMachine() == false) {
+            printf("ERROR: Incorrect input");
+        }
+
+        if (TransitionHits != NULL) {
+            ProfileWrite();
+        }
+        ReleaseMachine();
+    }
+
+    FreeMemory();
+    free(Heap);
+    free(Effects);
+    free(EffectSets);
+    free(TrackTransitions);
+    FreeTapesMachine();
+    CacheFree(Cache);
+    free(TapeBuffer);
+    LargeFree(DetTape.Symbols);
+    if (SpillFile != NULL) {
+        fclose(SpillFile);
+    }
+    free(SpillBatches);
+    if (TraceFile != NULL) {
+        TraceFlush();
+        fclose(TraceFile);
+    }
+    if (Visited != NULL) {
+        VisitedReport(Visited, &VisitedCounters);
+        VisitedFree(Visited);
+    }
+    PerfReport();
+
+    return 0;
+}
+
+// Read a line of machine input and put it into OutString (Mind the \n char!). False at end of input
+bool ReadInput(char * OutString, int StringSize) {
+    OutString[0] = '\0';
+    return fgets(OutString, sizeof(char)*StringSize, MachineInput) != NULL;
+}
+
+// Machines of batch mode: files listed in manifest, or standard input split at BATCHDELIMITER lines
+BatchMachine * LoadBatch(size_t * Count) {
+    FILE * Source = (ManifestPath != NULL) ? fopen(ManifestPath, "r") : stdin;
+    BatchMachine * Machines = NULL;
+    size_t Capacity = 0, LineSize = 0;
+    char * Line = NULL;
+    ssize_t Length;
+    bool Open = false;
+
+    *Count = 0;
+    if (Source == NULL) {
+        fprintf(stderr, "ERROR: Cannot open manifest %s\n", ManifestPath);
+        return NULL;
+    }
+
+    while ((Length = getline(&Line, &LineSize, Source)) > 0) {
+        bool Delimiter = (strcmp(Line, BATCHDELIMITER) == 0);
+
+        if (ManifestPath != NULL && Line[Length - 1] == '\n') {
+            Line[--Length] = '\0';
+        }
+        if ((ManifestPath != NULL && Length == 0) || (ManifestPath == NULL && Open == false && Delimiter == true)) {
+            continue;
+        }
+
+        if (Open == false) {
+            if (*Count == Capacity) {
+                Capacity = (Capacity == 0) ? 64 : Capacity * 2;
+                Machines = realloc(Machines, sizeof(BatchMachine) * Capacity);
+            }
+            Machines[*Count].Text = NULL;
+            Machines[*Count].Length = 0;
+            Machines[*Count].Path = NULL;
+            (*Count)++;
+        }
+
+        if (ManifestPath != NULL) {
+            Machines[*Count - 1].Path = strdup(Line);
+        } else if (Delimiter == true) {
+            Open = false;
+        } else {
+            BatchMachine * Machine = &Machines[*Count - 1];
+
+            Machine->Text = realloc(Machine->Text, Machine->Length + (size_t) Length);
+            memcpy(Machine->Text + Machine->Length, Line, (size_t) Length);
+            Machine->Length += (size_t) Length;
+            Open = true;
+        }
+    }
+
+    free(Line);
+    if (Source != stdin) {
+        fclose(Source);
+    }
+    return Machines;
+}
+
+// Runs every machine, printing its results followed by a BATCHDELIMITER line. With more than one worker, machines
+// are dealt round robin to worker processes, each one running its machines one after the other as a single
+// machine process would, and results are collected from their pipes in machine order
+void RunBatch(BatchMachine * Machines, size_t Count) {
+    size_t Workers = (BatchWorkers > 0) ? (size_t) BatchWorkers : (size_t) sysconf(_SC_NPROCESSORS_ONLN), LineSize = 0, i, w;
+    FILE ** Outputs;
+    pid_t * Pids;
+    char * Line = NULL;
+    int Pipe[2];
+
+    Workers = (Workers > Count) ? Count : Workers;
+    if (Workers <= 1) {
+        for (i = 0; i < Count; i++) {
+            RunBatchMachine(&Machines[i]);
+            fputs(BATCHDELIMITER, stdout);
+        }
+        return;
+    }
+
+    Outputs = malloc(sizeof(FILE *) * Workers);
+    Pids = malloc(sizeof(pid_t) * Workers);
+    fflush(stdout);
+
+    for (w = 0; w < Workers; w++) {
+        if (pipe(Pipe) != 0 || (Pids[w] = fork()) < 0) {
+            fprintf(stderr, "ERROR: Cannot start batch workers\n");
+            exit(1);
+        }
+
+        if (Pids[w] == 0) {
+            for (i = 0; i < w; i++) {
+                fclose(Outputs[i]);
+            }
+            close(Pipe[0]);
+            dup2(Pipe[1], STDOUT_FILENO);
+            close(Pipe[1]);
+
+            for (i = w; i < Count; i += Workers) {
+                RunBatchMachine(&Machines[i]);
+                fputs(BATCHDELIMITER, stdout);
+                fflush(stdout);
+            }
+            free(Outputs);
+            free(Pids);
+            exit(0);
+        }
+
+        close(Pipe[1]);
+        Outputs[w] = fdopen(Pipe[0], "r");
+    }
+
+    for (i = 0; i < Count; i++) {
+        bool Ended = false;
+
+        while (Ended == false && getline(&Line, &LineSize, Outputs[i % Workers]) > 0) {
+            Ended = (strcmp(Line, BATCHDELIMITER) == 0);
+            if (Ended == false) {
+                fputs(Line, stdout);
+            }
+        }
+        if (Ended == false) {
+            printf("ERROR: Batch worker stopped\n");
+        }
+        fputs(BATCHDELIMITER, stdout);
+    }
+
+    for (w = 0; w < Workers; w++) {
+        fclose(Outputs[w]);
+        waitpid(Pids[w], NULL, 0);
+    }
+    free(Line);
+    free(Outputs);
+    free(Pids);
+}
+
+// Runs a machine of batch mode, keeping tapes, stacks, caches and buffers of the previous ones
+void RunBatchMachine(const BatchMachine * Machine) {
+    char InstructionCode[INSTRLENGTH] = "";
+
+    MachineInput = (Machine->Path != NULL) ? fopen(Machine->Path, "r") : fmemopen(Machine->Text, Machine->Length, "r");
+    if (MachineInput == NULL) {
+        printf("ERROR: Cannot open machine %s\n", Machine->Path != NULL ? Machine->Path : "");
+        MachineInput = stdin;
+        return;
+    }
+
+    TM = malloc(sizeof(RB_Tree));
+    InitTM();
+
+    ReadInput(InstructionCode, INSTRLENGTH);
+    if (strcmp(InstructionCode, "tr\n") != 0 || SetupTuringMachine() == false) {
+        printf("ERROR: Incorrect input\n");
+    }
+    ReleaseMachine();
+
+    fclose(MachineInput);
+    MachineInput = stdin;
+}
+
+// Frees what was built from current machine. Tapes, stacks and buffers are kept for the next one
+void ReleaseMachine() {
+    FreeTM();
+    FreePackedMachine();
+    free(TapesFirst);
+    TapesFirst = NULL;
+    TapesTransitionCount = 0;
+    TrackTransitionCount = 0;
+    TrackSymbolCount = 0;
+    memset(TrackAlphabet, 0, sizeof(TrackAlphabet));
+}
+
+// Search function for RB tree
+TreeNode * SearchNode(RB_Tree *T, TreeNode * x, unsigned int id) {
+    if (x == NULL || x == T->nil || (x->StatePtr != NULL && id == x->StatePtr->id)) {
+        return x;
+    }
+
+    if (x->StatePtr == NULL) {
+        return T->nil;
+    }
+
+    if (id < x->StatePtr->id) {
+        return SearchNode(T, x->left, id);
+    } else {
+        return SearchNode(T, x->right, id);
+    }
+}
+
+void InOrderTreeWalk(TreeNode * x) {
+    if (x != TM->nil) {
+        InOrderTreeWalk(x->left);
+
+        State * CurrState = x->StatePtr;
+        unsigned int k, t;
+
+        printf("State nr. %u ; IsAccState: %d\n", CurrState->id, CurrState->IsAcceptanceState);
+        for (k = 0; k < CurrState->KeyCount; k++) {
+            printf("\tRead [%c]:\n", CurrState->Keys[k]);
+
+            for (t = CurrState->FirstTransition[k]; t < CurrState->FirstTransition[k + 1]; t++) {
+                printf("\t\tWrite: %c ; Move: %c ; ToState: %u\n", Packed[t].Write, MoveDirections[Packed[t].Move], States[Packed[t].ToState]->id);
+            }
+        }
+
+        InOrderTreeWalk(x->right);
+    }
+}
+
+// RB tree left rotation
+void LeftRotate(RB_Tree * T, TreeNode * x) {
+    TreeNode * y = x->right;
+    x->right = y->left;
+
+    if (y->left != T->nil) {
+        y->left->p = x;
+    }
+
+    y->p = x->p;
+
+    if (x->p == T->nil) {
+        T->root = y;
+    } else if (x == x->p->left) {
+        x->p->left = y;
+    } else {
+        x->p->right = y;
+    }
+    y->left = x;
+    x->p = y;
+}
+
+// RB tree right rotation
+void RightRotate(RB_Tree * T, TreeNode * x) {
+    TreeNode * y = x->left;
+    x->left = y->right;
+
+    if (y->right != T->nil) {
+        y->right->p = x;
+    }
+
+    y->p = x->p;
+
+    if (x->p == T->nil) {
+        T->root = y;
+    } else if (x == x->p->right) {
+        x->p->right = y;
+    } else {
+        x->p->left = y;
+    }
+    y->right = x;
+    x->p = y;
+}
+
+// Insert function for RB tree
+void TreeInsert(RB_Tree * T, TreeNode * z) {
+    TreeNode * y = T->nil;
+    TreeNode * x = T->root;
+
+    while (x != T->nil) {
+        y = x;
+        if (z->StatePtr->id < x->StatePtr->id) {
+            x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+
+    z->p = y;
+
+    if (y == T->nil) {
+        T->root = z;        // Empty tree
+    } else if (z->StatePtr->id < y->StatePtr->id) {
+        y->left = z;
+    } else {
+        y->right = z;
+    }
+
+    z->left = T->nil;
+    z->right = T->nil;
+    z->color = red;
+
+    RBInsertFixup(T, z);
+}
+
+// Insert-Fixup function for RB tree
+void RBInsertFixup(RB_Tree * T, TreeNode * z) {
+    if (z == T->root) {
+        T->root->color = black;
+    } else {
+        TreeNode * x = z->p;
+
+        if (x->color == red) {
+            if (x == x->p->left) {
+                TreeNode * y = x->p->right;
+
+                if (y->color == red) {
+                    x->color = black;
+                    y->color = black;
+                    x->p->color = red;
+                    RBInsertFixup(T, x->p);
+                } else {
+                    if (z == x->right) {
+                        z = x;
+                        LeftRotate(T, z);
+                        x = z->p;
+                    }
+
+                    x->color = black;
+                    x->p->color = red;
+                    RightRotate(T, x->p);
+                }
+            } else {
+                TreeNode * y = x->p->left;
+
+                if (y->color == red) {
+                    x->color = black;
+                    y->color = black;
+                    x->p->color = red;
+                    RBInsertFixup(T, x->p);
+                } else {
+                    if (z == x->left) {
+                        z = x;
+                        RightRotate(T, z);
+                        x = z->p;
+                    }
+
+                    x->color = black;
+                    x->p->color = red;
+                    LeftRotate(T, x->p);
+                }
+            }
+        }
+    }
+}
+
+// Initialization of memory tape and TM
+void InitTM() {
+    TapeReserve(0);
+
+    // Init TM nil node
+    TM->nil = malloc(sizeof(TreeNode));
+    TM->nil->p = NULL;
+    TM->nil->left = NULL;
+    TM->nil->right = NULL;
+    TM->nil->color = black;
+    TM->nil->StatePtr = NULL;
+
+    // Init TM root
+    TM->root = malloc(sizeof(TreeNode));
+    TM->root->p = TM->nil;
+    TM->root->left = TM->nil;
+    TM->root->right = TM->nil;
+    TM->root->color = black;
+
+    // Init state 0
+    TM->root->StatePtr = malloc(sizeof(State));
+    TM->root->StatePtr->CharacterList = NULL;
+    TM->root->StatePtr->IsAcceptanceState = false;
+    TM->root->StatePtr->id = 0;
+}
+
+// Loads the machine after its "tr" line, then runs its tapes. False if machine input ends before "run"
+bool SetupTuringMachine() {
+    char StateInput[TRLENGTH + 3 * MAXTAPES];
+    unsigned int StartState, EndState;
+    char ReadSymbol, WriteSymbol, MemDirection;
+    char ReadTuple[MAXTRACKS + 1], WriteTuple[MAXTRACKS + 1], MoveTuple[MAXTAPES + 1];
+
+    if (ReadInput(StateInput, TRLENGTH + 3 * MAXTAPES) == false) {
+        return false;
+    }
+
+    while (strcmp(StateInput, "acc\n") != 0) {
+        if (TapeCount > 1) {
+            if (sscanf(StateInput, "%u %8s %8s %8s %u\n", &StartState, ReadTuple, WriteTuple, MoveTuple, &EndState) == 5) {
+                AddTapesTransition(StartState, EndState, ReadTuple, WriteTuple, MoveTuple);
+            }
+        } else if (TrackCount > 1) {
+            // Multi-track transitions are expanded once all of them are known
+            if (sscanf(StateInput, "%u %8s %8s %c %u\n", &StartState, ReadTuple, WriteTuple, &MemDirection, &EndState) == 5) {
+                AddTrackTransition(StartState, EndState, ReadTuple, WriteTuple, MemDirection);
+            }
+        } else if (sscanf(StateInput, "%u %c %c %c %u\n", &StartState, &ReadSymbol, &WriteSymbol, &MemDirection, &EndState) == 5) {
+            // Add end state of transition to TM (if it doesn't exists)
+            AddStateToTM(EndState);
+            // Add scanned transition to TM
+            AddTransitionToTM(StartState, EndState, ReadSymbol, WriteSymbol, MemDirection);
+        }
+
+        if (ReadInput(StateInput, TRLENGTH + 3 * MAXTAPES) == false) {
+            return false;
+        }
+    }
+
+    if (TrackCount > 1) {
+        size_t i, Unique = 0;
+
+        // Sorted and without duplicates, as they are part of machine fingerprint
+        qsort(TrackTransitions, TrackTransitionCount, sizeof(TrackTransition), CompareTrackTransitions);
+        for (i = 0; i < TrackTransitionCount; i++) {
+            if (Unique == 0 || CompareTrackTransitions(&TrackTransitions[Unique - 1], &TrackTransitions[i]) != 0) {
+                TrackTransitions[Unique++] = TrackTransitions[i];
+            }
+            if (TrackTransitions[i].Read[0] != '*') {
+                TrackAlphabet[(unsigned char) TrackTransitions[i].Read[0]] = true;
+            }
+            if (TrackTransitions[i].Write[0] != '*') {
+                TrackAlphabet[(unsigned char) TrackTransitions[i].Write[0]] = true;
+            }
+        }
+        TrackTransitionCount = Unique;
+        TrackAlphabet['_'] = true;
+
+        ExpandTrackTransitions();
+    }
+
+    return SetupAccStatesAndMoves();
+}
+
+TreeNode * AddStateToTM(unsigned int id) {
+    TreeNode * NewState = SearchNode(TM, TM->root, id);
+    if (NewState == TM->nil) {
+        NewState = malloc(sizeof(TreeNode));
+        NewState->StatePtr = malloc(sizeof(State));
+
+        NewState->StatePtr->id = id;
+        NewState->StatePtr->IsAcceptanceState = false;
+        NewState->StatePtr->Priority = 0;
+        NewState->StatePtr->CharacterList = NULL;
+
+        TreeInsert(TM, NewState);
+        return NewState;
+    } else {
+        return NewState;
+    }
+}
+
+void AddTransitionToTM(unsigned int Start, unsigned int End, char Read, char Write, char MemDirection) {
+    TreeNode * NewState = AddStateToTM(Start);
+    Transition * NewTransition = malloc(sizeof(Transition));
+
+    // Init new transition to add
+    NewTransition->Read = Read;
+    NewTransition->Write = Write;
+    NewTransition->ToState = SearchNode(TM, TM->root, End)->StatePtr;
+    NewTransition->HeadMoveDirection = MemDirection;
+    NewTransition->NextTransition = NULL;
+
+    AddTransitionToState(NewState->StatePtr, NewTransition);
+
+}
+
+// Keeps multi-track transition until every symbol used by each track is known
+void AddTrackTransition(unsigned int Start, unsigned int End, const char * Read, const char * Write, char MemDirection) {
+    TrackTransition * NewTransition;
+
+    if (strlen(Read) != TrackCount || strlen(Write) != TrackCount) {
+        fprintf(stderr, "WARNING: Transition from state %u ignored, it must have %u tracks\n", Start, TrackCount);
+        return;
+    }
+    for (unsigned int k = 0; k < TrackCount; k++) {
+        if ((unsigned char) Read[k] >= FIRSTTRACKCODE || (unsigned char) Write[k] >= FIRSTTRACKCODE) {
+            fprintf(stderr, "ERROR: Symbols of multi-track transitions must be below %d\n", FIRSTTRACKCODE);
+            exit(1);
+        }
+    }
+
+    if (TrackTransitionCount == TrackTransitionCapacity) {
+        TrackTransitionCapacity = (TrackTransitionCapacity == 0) ? 64 : TrackTransitionCapacity * 2;
+        TrackTransitions = realloc(TrackTransitions, sizeof(TrackTransition) * TrackTransitionCapacity);
+    }
+
+    NewTransition = &TrackTransitions[TrackTransitionCount++];
+    NewTransition->Start = Start;
+    NewTransition->End = End;
+    strcpy(NewTransition->Read, Read);
+    strcpy(NewTransition->Write, Write);
+    NewTransition->MemDirection = MemDirection;
+}
+
+// Orders multi-track transitions by start state, read and write symbols, move and end state
+int CompareTrackTransitions(const void * a, const void * b) {
+    const TrackTransition * TransA = a;
+    const TrackTransition * TransB = b;
+    int Order;
+
+    if (TransA->Start != TransB->Start) {
+        return TransA->Start < TransB->Start ? -1 : 1;
+    }
+    if ((Order = strcmp(TransA->Read, TransB->Read)) != 0) {
+        return Order;
+    }
+    if ((Order = strcmp(TransA->Write, TransB->Write)) != 0) {
+        return Order;
+    }
+    if (TransA->MemDirection != TransB->MemDirection) {
+        return TransA->MemDirection < TransB->MemDirection ? -1 : 1;
+    }
+    if (TransA->End != TransB->End) {
+        return TransA->End < TransB->End ? -1 : 1;
+    }
+    return 0;
+}
+
+// Adds to TM every multi-track transition, once per tuple matching its read wildcards. A wildcard on
+// a track matches blank and every symbol the machine uses on that track, and on the first track every
+// input symbol of TrackAlphabet too
+void ExpandTrackTransitions() {
+    char Alphabet[MAXTRACKS][256];
+    unsigned int AlphabetSize[MAXTRACKS];
+    unsigned int Digit[MAXTRACKS];
+    char Read[MAXTRACKS], Write[MAXTRACKS];
+    size_t i;
+    unsigned int k;
+
+    AlphabetSize[0] = 0;
+    for (i = 0; i < 256; i++) {
+        if (TrackAlphabet[i] == true) {
+            Alphabet[0][AlphabetSize[0]++] = (char) i;
+        }
+    }
+    for (k = 1; k < TrackCount; k++) {
+        Alphabet[k][0] = '_';
+        AlphabetSize[k] = 1;
+    }
+    for (i = 0; i < TrackTransitionCount; i++) {
+        for (k = 1; k < TrackCount; k++) {
+            char Used[2] = {TrackTransitions[i].Read[k], TrackTransitions[i].Write[k]};
+
+            for (unsigned int u = 0; u < 2; u++) {
+                if (Used[u] == '*' || memchr(Alphabet[k], Used[u], AlphabetSize[k]) != NULL) {
+                    continue;
+                }
+                Alphabet[k][AlphabetSize[k]++] = Used[u];
+            }
+        }
+    }
+
+    for (i = 0; i < TrackTransitionCount; i++) {
+        TrackTransition * Pattern = &TrackTransitions[i];
+
+        AddStateToTM(Pattern->End);
+        memset(Digit, 0, sizeof(Digit));
+
+        do {
+            for (k = 0; k < TrackCount; k++) {
+                Read[k] = (Pattern->Read[k] == '*') ? Alphabet[k][Digit[k]] : Pattern->Read[k];
+                Write[k] = (Pattern->Write[k] == '*') ? Read[k] : Pattern->Write[k];
+            }
+            AddTransitionToTM(Pattern->Start, Pattern->End, InternTrackSymbol(Read), InternTrackSymbol(Write), Pattern->MemDirection);
+
+            // Next tuple matching read wildcards
+            for (k = 0; k < TrackCount; k++) {
+                if (Pattern->Read[k] == '*') {
+                    if (++Digit[k] < AlphabetSize[k]) {
+                        break;
+                    }
+                    Digit[k] = 0;
+                }
+            }
+        } while (k < TrackCount);
+    }
+}
+
+// Adds the symbols of [Input] to TrackAlphabet, and packs the machine again if first track wildcards have to match
+// some new one. Tapes are checked as they run, so that they don't have to be read before the machine
+void ExpandTrackInputs(const char * Input, size_t Length) {
+    bool Grown = false;
+    size_t i;
+
+    for (i = 0; i < Length; i++) {
+        unsigned char Symbol = (unsigned char) Input[i];
+
+        if (Symbol >= FIRSTTRACKCODE) {
+            fprintf(stderr, "ERROR: Input symbols of multi-track tapes must be below %d\n", FIRSTTRACKCODE);
+            exit(1);
+        }
+        if (TrackAlphabet[Symbol] == false && Symbol != '*') {
+            TrackAlphabet[Symbol] = true;
+            Grown = true;
+        }
+    }
+
+    for (i = 0; Grown == true && i < TrackTransitionCount; i++) {
+        if (TrackTransitions[i].Read[0] == '*') {
+            RepackTrackMachine();
+            return;
+        }
+    }
+}
+
+// Expands multi-track transitions again for the grown TrackAlphabet and packs them. States, their indexes and
+// machine fingerprint stay the same, as the wildcards are. Profile counts go to the same transitions once packed
+void RepackTrackMachine() {
+    TransitionCount * Counts = NULL;
+    size_t CountTotal = 0, i;
+    uint32_t s, k, t;
+
+    if (TransitionHits != NULL) {
+        Counts = malloc(sizeof(TransitionCount) * (PackedTransitionCount() + 1));
+        for (s = 0; s < StateCount; s++) {
+            for (k = 0; k < States[s]->KeyCount; k++) {
+                for (t = States[s]->FirstTransition[k]; t < States[s]->FirstTransition[k + 1]; t++) {
+                    if (TransitionHits[t] > 0) {
+                        Counts[CountTotal++] = (TransitionCount) {s, States[s]->Keys[k], Packed[t], TransitionHits[t]};
+                    }
+                }
+            }
+        }
+        free(TransitionHits);
+    }
+
+    FreePackedMachine();
+    ExpandTrackTransitions();
+    PackMachine();
+
+    if (Counts != NULL) {
+        uint64_t * Backtracks = StateBacktracks;
+
+        ProfileCreate();
+        free(StateBacktracks);
+        StateBacktracks = Backtracks;
+        for (i = 0; i < CountTotal; i++) {
+            State * From = States[Counts[i].From];
+            int Key = SearchReadSymbol(From, Counts[i].Read);
+
+            for (t = From->FirstTransition[Key]; t < From->FirstTransition[Key + 1]; t++) {
+                if (Packed[t].ToState == Counts[i].Transition.ToState && Packed[t].Write == Counts[i].Transition.Write &&
+                    Packed[t].Move == Counts[i].Transition.Move) {
+                    TransitionHits[t] = Counts[i].Hits;
+                }
+            }
+        }
+        free(Counts);
+    }
+
+    SelectEngine();
+    TraceMachineChanged = (TraceFile != NULL);
+}
+
+// Returns tape symbol of [Tuple]. Tuples with blank on every track but the first are the first track symbol
+// itself, so that input tapes are read as they are. Other tuples get codes from FIRSTTRACKCODE on
+char InternTrackSymbol(const char * Tuple) {
+    unsigned int k, s;
+
+    for (k = 1; k < TrackCount && Tuple[k] == '_'; k++);
+    if (k == TrackCount) {
+        return Tuple[0];
+    }
+
+    for (s = 0; s < TrackSymbolCount; s++) {
+        if (memcmp(TrackSymbols[s], Tuple, TrackCount) == 0) {
+            return (char) (FIRSTTRACKCODE + s);
+        }
+    }
+
+    if (TrackSymbolCount == 256 - FIRSTTRACKCODE) {
+        fprintf(stderr, "ERROR: Too many multi-track symbols\n");
+        exit(1);
+    }
+    memcpy(TrackSymbols[TrackSymbolCount], Tuple, TrackCount);
+    return (char) (FIRSTTRACKCODE + TrackSymbolCount++);
+}
+
+// Adds multi-tape transition, with a read, a write and a move char for every tape
+void AddTapesTransition(unsigned int Start, unsigned int End, const char * Read, const char * Write, const char * Moves) {
+    TapesTransition * NewTransition;
+    unsigned int t;
+
+    if (strlen(Read) != TapeCount || strlen(Write) != TapeCount || strlen(Moves) != TapeCount) {
+        fprintf(stderr, "WARNING: Transition from state %u ignored, it must have %u tapes\n", Start, TapeCount);
+        return;
+    }
+
+    AddStateToTM(Start);
+    AddStateToTM(End);
+
+    if (TapesTransitionCount == TapesTransitionCapacity) {
+        TapesTransitionCapacity = (TapesTransitionCapacity == 0) ? 64 : TapesTransitionCapacity * 2;
+        TapesTransitions = realloc(TapesTransitions, sizeof(TapesTransition) * TapesTransitionCapacity);
+    }
+
+    // Cleared so that padding doesn't change machine fingerprint
+    NewTransition = &TapesTransitions[TapesTransitionCount++];
+    memset(NewTransition, 0, sizeof(TapesTransition));
+    NewTransition->Start = Start;
+    NewTransition->End = End;
+    for (t = 0; t < TapeCount; t++) {
+        NewTransition->Read[t] = Read[t];
+        NewTransition->Write[t] = Write[t];
+        NewTransition->Move[t] = (Moves[t] == 'L') ? MoveLeft : (Moves[t] == 'R') ? MoveRight : MoveStay;
+    }
+}
+
+void AddTransitionToState(State * TMState, Transition * ToAdd) {
+    // Check if transition already exists
+    if (SearchTransition(TMState->CharacterList, ToAdd) == NULL) {
+        AddTransitionToList(TMState, ToAdd);
+    }
+}
+
+
+void AddTransitionToList(State * TMState, Transition *ToAdd) {
+    if (TMState->CharacterList == NULL) {
+        // Allocate memory for a new Character element
+        TransitionList * NewCharacterElement = malloc(sizeof(TransitionList));
+
+        // Initialize new char element
+        NewCharacterElement->Character = ToAdd->Read;
+        NewCharacterElement->Next = NULL;
+        NewCharacterElement->Transitions = ToAdd;
+        TMState->CharacterList = NewCharacterElement;
+
+    } else {
+        TransitionList * CharacterElement = TMState->CharacterList;
+
+        // Find element of CharacterList that matches read character
+        while (CharacterElement->Next != NULL && (CharacterElement->Character != ToAdd->Read)) {
+            CharacterElement = CharacterElement->Next;
+        }
+
+        if (CharacterElement->Next != NULL || (CharacterElement->Character == ToAdd->Read)) {
+            // Add [ToAdd] to the head of the transitions list
+            ToAdd->NextTransition = CharacterElement->Transitions;
+            CharacterElement->Transitions = ToAdd;
+        } else {
+            // Allocate memory for a new Character element
+            TransitionList * NewCharacterElement = malloc(sizeof(TransitionList));
+
+            // Initialize new char element
+            NewCharacterElement->Character = ToAdd->Read;
+            NewCharacterElement->Next = NULL;
+            NewCharacterElement->Transitions = ToAdd;
+
+            CharacterElement->Next = NewCharacterElement;
+        }
+    }
+}
+
+Transition * SearchTransition(TransitionList * List, Transition * ToSearch) {
+    TransitionList * CharacterElement = List;
+
+    // Find element of CharacterList that matches read character
+    while (CharacterElement != NULL && CharacterElement->Character != ToSearch->Read) {
+        CharacterElement = CharacterElement->Next;
+    }
+
+    // CharacterElement points to element that has same Character as ToSearch->Read
+    if (CharacterElement != NULL) {
+        Transition * TransitionElement = CharacterElement->Transitions;
+
+        while (TransitionElement != NULL && (TransitionElement->Write != ToSearch->Write || TransitionElement->ToState != ToSearch->ToState || TransitionElement->HeadMoveDirection != ToSearch->HeadMoveDirection)) {
+            TransitionElement = TransitionElement->NextTransition;
+        }
+
+        return TransitionElement;
+
+    } else {
+        return NULL;
+    }
+
+}
+
+// Returns index in CurrState->Keys of [ToSearch], -1 if there are no transitions for it
+int SearchReadSymbol(const State * CurrState, char ToSearch) {
+    unsigned int k;
+
+#ifdef __SSE2__
+    __m128i Needle = _mm_set1_epi8(ToSearch);
+
+    for (k = 0; k < CurrState->KeyCount; k += KEYBLOCK) {
+        unsigned int Mask = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *) (CurrState->Keys + k)), Needle));
+
+        if (CurrState->KeyCount - k < KEYBLOCK) {
+            Mask &= (1u << (CurrState->KeyCount - k)) - 1;
+        }
+        if (Mask != 0) {
+            return (int) k + __builtin_ctz(Mask);
+        }
+    }
+#else
+    for (k = 0; k < CurrState->KeyCount; k++) {
+        if (CurrState->Keys[k] == ToSearch) {
+            return (int) k;
+        }
+    }
+#endif
+
+    return -1;
+}
+
+// Copies transitions of every state in contiguous arrays, indexed by state index, then frees transition lists
+void PackMachine() {
+    size_t KeyTotal = 0, TransTotal = 0;
+
+    StateCount = 0;
+    CountPackedStates(TM->root, &KeyTotal, &TransTotal);
+
+    States = malloc(sizeof(State *) * StateCount);
+    // Blocks of LargeAlloc are at least max_align_t aligned, enough for key blocks
+    _Static_assert(KEYBLOCK <= _Alignof(max_align_t), "KEYBLOCK exceeds malloc alignment");
+    KeyPool = LargeAlloc(KeyTotal > 0 ? KeyTotal : KEYBLOCK);
+    FirstPool = LargeAlloc(sizeof(uint32_t) * (KeyTotal + StateCount));
+    Packed = LargeAlloc(sizeof(PackedTransition) * (TransTotal > 0 ? TransTotal : 1));
+
+    KeyTotal = 0;
+    TransTotal = 0;
+    FillPackedStates(TM->root, &KeyTotal, &TransTotal);
+
+    FreeTransitions(TM->root);
+    GroupMachine(TransTotal);
+    ComputeAcceptance();
+    ComputeGoalDistances();
+}
+
+// Builds acceptance bitmap, and for every state and read char the min nr. of moves that surely lead to acceptance
+// through transitions that don't move the head, as they don't depend on the rest of the tape
+void ComputeAcceptance() {
+    size_t KeyTotal = 0;
+    unsigned int s, k;
+    bool Changed = true;
+
+    AcceptMask = calloc(SetWords > 0 ? SetWords : 1, sizeof(uint64_t));
+    for (s = 0; s < StateCount; s++) {
+        KeyTotal += States[s]->KeyCount;
+        if (States[s]->IsAcceptanceState == true) {
+            AcceptMask[s / 64] |= 1ULL << (s % 64);
+        }
+    }
+
+    DistancePool = LargeAlloc(sizeof(uint32_t) * (KeyTotal > 0 ? KeyTotal : 1));
+    KeyTotal = 0;
+    for (s = 0; s < StateCount; s++) {
+        States[s]->AcceptDistance = DistancePool + KeyTotal;
+        KeyTotal += States[s]->KeyCount;
+
+        for (k = 0; k < States[s]->KeyCount; k++) {
+            States[s]->AcceptDistance[k] = (States[s]->IsAcceptanceState == true) ? 0 : NOACCEPT;
+        }
+    }
+
+    // Relax distances until no chain of moves without head movement gets shorter
+    while (Changed == true) {
+        Changed = false;
+
+        for (s = 0; s < StateCount; s++) {
+            State * CurrState = States[s];
+
+            for (k = 0; k < CurrState->KeyCount; k++) {
+                uint32_t t;
+
+                for (t = CurrState->FirstTransition[k]; t < CurrState->FirstTransition[k + 1]; t++) {
+                    uint32_t Distance;
+
+                    if (Packed[t].Move != MoveStay) {
+                        continue;
+                    }
+
+                    Distance = StateAcceptDistance(Packed[t].ToState, Packed[t].Write);
+                    if (Distance != NOACCEPT && Distance + 1 < CurrState->AcceptDistance[k]) {
+                        CurrState->AcceptDistance[k] = Distance + 1;
+                        Changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Min nr. of moves to acceptance from state [StateIndex] reading [Read] without moving the head
+uint32_t StateAcceptDistance(uint32_t StateIndex, char Read) {
+    State * CurrState = States[StateIndex];
+    int Key;
+
+    if (CurrState->IsAcceptanceState == true) {
+        return 0;
+    }
+
+    Key = SearchReadSymbol(CurrState, Read);
+    return (Key < 0) ? NOACCEPT : CurrState->AcceptDistance[Key];
+}
+
+// Groups transitions of every state and read char by tape effect, with the bitset of states each effect leads to
+void GroupMachine(size_t TransTotal) {
+    size_t KeyTotal = 0, GroupTotal = 0, i;
+    unsigned int s, k;
+
+    SetWords = (StateCount + 63) / 64;
+    for (s = 0; s < StateCount; s++) {
+        KeyTotal += States[s]->KeyCount + 1;
+    }
+
+    GroupFirstPool = LargeAlloc(sizeof(uint32_t) * KeyTotal);
+    Groups = LargeAlloc(sizeof(EffectGroup) * (TransTotal > 0 ? TransTotal : 1));
+    TargetPool = LargeAlloc(sizeof(uint64_t) * (TransTotal > 0 ? TransTotal : 1) * SetWords);
+    memset(TargetPool, 0, sizeof(uint64_t) * (TransTotal > 0 ? TransTotal : 1) * SetWords);
+    SingleSet = malloc(sizeof(uint64_t) * SetWords);
+
+    KeyTotal = 0;
+    for (s = 0; s < StateCount; s++) {
+        State * CurrState = States[s];
+
+        CurrState->FirstGroup = GroupFirstPool + KeyTotal;
+        KeyTotal += CurrState->KeyCount + 1;
+
+        for (k = 0; k < CurrState->KeyCount; k++) {
+            size_t Count = CurrState->FirstTransition[k + 1] - CurrState->FirstTransition[k];
+
+            if (Count > EffectCapacity) {
+                EffectCapacity = Count * 2;
+                Effects = realloc(Effects, sizeof(PackedTransition) * EffectCapacity);
+            }
+            memcpy(Effects, &Packed[CurrState->FirstTransition[k]], sizeof(PackedTransition) * Count);
+            qsort(Effects, Count, sizeof(PackedTransition), CompareEffects);
+
+            CurrState->FirstGroup[k] = (uint32_t) GroupTotal;
+            for (i = 0; i < Count; i++) {
+                EffectGroup * Group = &Groups[GroupTotal - 1];
+
+                if (i == 0 || Effects[i].Write != Effects[i - 1].Write || Effects[i].Move != Effects[i - 1].Move) {
+                    Group = &Groups[GroupTotal];
+                    Group->Write = Effects[i].Write;
+                    Group->Move = Effects[i].Move;
+                    Group->HasLoop = false;
+                    Group->Targets = (uint32_t) (GroupTotal * SetWords);
+                    Group->Lowest = UINT32_MAX;
+                    Group->StateCount = 0;
+                    GroupTotal++;
+                }
+
+                if (Effects[i].Move == MoveStay && Effects[i].Write == CurrState->Keys[k] && Effects[i].ToState == s) {
+                    Group->HasLoop = true;
+                } else if ((TargetPool[Group->Targets + Effects[i].ToState / 64] & (1ULL << (Effects[i].ToState % 64))) == 0) {
+                    TargetPool[Group->Targets + Effects[i].ToState / 64] |= 1ULL << (Effects[i].ToState % 64);
+                    Group->Lowest = (Effects[i].ToState < Group->Lowest) ? Effects[i].ToState : Group->Lowest;
+                    Group->StateCount++;
+                }
+            }
+        }
+        CurrState->FirstGroup[CurrState->KeyCount] = (uint32_t) GroupTotal;
+    }
+}
+
+// Numbers states in id order and counts space needed by their keys and transitions
+void CountPackedStates(TreeNode * x, size_t * KeyTotal, size_t * TransTotal) {
+    if (x != TM->nil) {
+        CountPackedStates(x->left, KeyTotal, TransTotal);
+
+        TransitionList * CharElem;
+        Transition * TransElem;
+        unsigned int KeyCount = 0;
+
+        for (CharElem = x->StatePtr->CharacterList; CharElem != NULL; CharElem = CharElem->Next) {
+            KeyCount++;
+            for (TransElem = CharElem->Transitions; TransElem != NULL; TransElem = TransElem->NextTransition) {
+                (*TransTotal)++;
+            }
+        }
+
+        x->StatePtr->Index = StateCount++;
+        x->StatePtr->KeyCount = KeyCount;
+        *KeyTotal += (KeyCount + KEYBLOCK - 1) / KEYBLOCK * KEYBLOCK;
+
+        CountPackedStates(x->right, KeyTotal, TransTotal);
+    }
+}
+
+void FillPackedStates(TreeNode * x, size_t * KeyTotal, size_t * TransTotal) {
+    if (x != TM->nil) {
+        FillPackedStates(x->left, KeyTotal, TransTotal);
+
+        State * CurrState = x->StatePtr;
+        TransitionList * CharElem;
+        Transition * TransElem;
+        unsigned int k = 0;
+
+        States[CurrState->Index] = CurrState;
+        CurrState->Keys = KeyPool + *KeyTotal;
+        CurrState->FirstTransition = FirstPool + *KeyTotal + CurrState->Index;
+        memset(CurrState->Keys, 0, (CurrState->KeyCount + KEYBLOCK - 1) / KEYBLOCK * KEYBLOCK);
+
+        // Transitions keep the order of their list
+        for (CharElem = CurrState->CharacterList; CharElem != NULL; CharElem = CharElem->Next) {
+            CurrState->Keys[k] = CharElem->Character;
+            CurrState->FirstTransition[k] = (uint32_t) *TransTotal;
+
+            for (TransElem = CharElem->Transitions; TransElem != NULL; TransElem = TransElem->NextTransition) {
+                Packed[*TransTotal].ToState = TransElem->ToState->Index;
+                Packed[*TransTotal].Write = TransElem->Write;
+                Packed[*TransTotal].Move = (TransElem->HeadMoveDirection == 'L') ? MoveLeft : (TransElem->HeadMoveDirection == 'R') ? MoveRight : MoveStay;
+                (*TransTotal)++;
+            }
+            k++;
+        }
+        CurrState->FirstTransition[k] = (uint32_t) *TransTotal;
+        *KeyTotal += (CurrState->KeyCount + KEYBLOCK - 1) / KEYBLOCK * KEYBLOCK;
+
+        FillPackedStates(x->right, KeyTotal, TransTotal);
+    }
+}
+
+// Switches multi-tape transitions from state ids to state indexes and groups them by start state and read chars.
+// Duplicated transitions are dropped, as single tape ones
+void PackTapesMachine() {
+    size_t i, Unique = 0;
+    unsigned int t;
+
+    for (i = 0; i < TapesTransitionCount; i++) {
+        TapesTransitions[i].Start = SearchNode(TM, TM->root, TapesTransitions[i].Start)->StatePtr->Index;
+        TapesTransitions[i].End = SearchNode(TM, TM->root, TapesTransitions[i].End)->StatePtr->Index;
+    }
+    qsort(TapesTransitions, TapesTransitionCount, sizeof(TapesTransition), CompareTapesTransitions);
+
+    for (i = 0; i < TapesTransitionCount; i++) {
+        if (Unique == 0 || CompareTapesTransitions(&TapesTransitions[Unique - 1], &TapesTransitions[i]) != 0) {
+            TapesTransitions[Unique++] = TapesTransitions[i];
+        }
+    }
+    TapesTransitionCount = Unique;
+
+    TapesFirst = malloc(sizeof(uint32_t) * (StateCount + 1));
+    for (i = 0, t = 0; t <= StateCount; t++) {
+        while (i < TapesTransitionCount && TapesTransitions[i].Start < t) {
+            i++;
+        }
+        TapesFirst[t] = (uint32_t) i;
+    }
+
+    // Tapes of previous machines of a batch are kept
+    for (t = 0; t < TapeCount; t++) {
+        if (MultiTapes[t].Symbols == NULL) {
+            MultiTapes[t] = (FlatTape) {NULL, 0, 0, 0, -1};
+        }
+    }
+
+    MachineFingerprint = HashBytes(MachineFingerprint, &TapeCount, sizeof(TapeCount));
+    MachineFingerprint = HashBytes(MachineFingerprint, TapesTransitions, sizeof(TapesTransition) * TapesTransitionCount);
+}
+
+// Orders multi-tape transitions by start state, read chars, then the rest
+int CompareTapesTransitions(const void * a, const void * b) {
+    const TapesTransition * TransA = a;
+    const TapesTransition * TransB = b;
+    int Order;
+
+    if (TransA->Start != TransB->Start) {
+        return TransA->Start < TransB->Start ? -1 : 1;
+    }
+    if ((Order = memcmp(TransA->Read, TransB->Read, MAXTAPES)) != 0) {
+        return Order;
+    }
+    if ((Order = memcmp(TransA->Write, TransB->Write, MAXTAPES)) != 0) {
+        return Order;
+    }
+    if ((Order = memcmp(TransA->Move, TransB->Move, MAXTAPES)) != 0) {
+        return Order;
+    }
+    if (TransA->End != TransB->End) {
+        return TransA->End < TransB->End ? -1 : 1;
+    }
+    return 0;
+}
+
+void FreeTapesMachine() {
+    unsigned int t;
+
+    for (t = 0; t < TapeCount; t++) {
+        LargeFree(MultiTapes[t].Symbols);
+    }
+    free(TapesTransitions);
+    free(TapesFirst);
+    free(TapesStack);
+    free(Trail);
+}
+
+void FreePackedMachine() {
+    free(States);
+    LargeFree(KeyPool);
+    LargeFree(FirstPool);
+    LargeFree(Packed);
+    LargeFree(Groups);
+    LargeFree(GroupFirstPool);
+    LargeFree(TargetPool);
+    free(SingleSet);
+    free(AcceptMask);
+    LargeFree(DistancePool);
+    LargeFree(DenseNext);
+
+    States = NULL;
+    KeyPool = NULL;
+    FirstPool = NULL;
+    Packed = NULL;
+    Groups = NULL;
+    GroupFirstPool = NULL;
+    TargetPool = NULL;
+    SingleSet = NULL;
+    AcceptMask = NULL;
+    DistancePool = NULL;
+    DenseNext = NULL;
+}
+
+uint32_t PackedTransitionCount() {
+    uint32_t Total = 0, s;
+
+    for (s = 0; s < StateCount; s++) {
+        Total += States[s]->FirstTransition[States[s]->KeyCount] - States[s]->FirstTransition[0];
+    }
+    return Total;
+}
+
+bool SetupAccStatesAndMoves() {
+    char AccStateStr[(TRLENGTH-7)/2];     // Max nr. of states
+    unsigned int AccState;
+
+    if (ReadInput(AccStateStr, (TRLENGTH-7)/2) == false) {
+        return false;
+    }
+
+    while (strcmp(AccStateStr, "max\n") != 0) {
+        // An acceptance state no transition reaches is still added, so it can be the initial one
+        if (sscanf(AccStateStr, "%u\n", &AccState) == 1) {
+            AddStateToTM(AccState)->StatePtr->IsAcceptanceState = true;
+        }
+
+        if (ReadInput(AccStateStr, (TRLENGTH-7)/2) == false) {
+            return false;
+        }
+    }
+
+    // Setup max moves
+    if (fscanf(MachineInput, "%ld\n", &Moves) != 1) {
+        return false;
+    }
+    MaxMoves = Moves;
+    DetMovesLeft = MaxMoves;
+
+    ComputeMachineFingerprint();
+    PackMachine();
+    if (TapeCount > 1) {
+        PackTapesMachine();
+    }
+    if (TraceFile != NULL) {
+        TraceWriteHeader();
+    }
+    if (ProfilePath != NULL && TapeCount == 1) {
+        ProfileCreate();
+    }
+    SelectEngine();
+    if (PriorityPath != NULL) {
+        LoadPriorities(PriorityPath);
+    }
+
+    ReadInput(AccStateStr, 6);
+    if (strcmp(AccStateStr, "run\n") == 0) {
+        RunInputs();
+    }
+
+    return true;
+}
+
+// Writes [Character] in cell at [Position] for current branch, keeping the symbol of outer branches
+void WriteOnTape(long Position, char Character) {
+    Cell * MemCell = TapeCell(Position);
+    char * MemSymbol = TapeSymbol(Position);
+
+    if (*MemSymbol == Character) {
+        return;
+    }
+
+    if (MemCell->BranchID != CurrBranchID && CurrBranchID > 0) {
+        Symbol * OldSymbol;
+
+        if (WrittenCount == WrittenCapacity) {
+            WrittenCapacity = (WrittenCapacity == 0) ? 256 : WrittenCapacity * 2;
+            WriteLog = LargeRealloc(WriteLog, sizeof(Symbol) * WrittenCapacity);
+        }
+        OldSymbol = &WriteLog[WrittenCount];
+
+        OldSymbol->Position = Position;
+        OldSymbol->BranchID = MemCell->BranchID;
+        OldSymbol->Symbol = *MemSymbol;
+        OldSymbol->Next = MemCell->Older;
+
+        MemCell->Older = (long) WrittenCount++;
+        MemCell->BranchID = CurrBranchID;
+    }
+    if (Visited != NULL) {
+        TapeHashCell(Position, *MemSymbol, Character);
+    }
+    if (Scheduler != LifoScheduler) {
+        DirtyMin = (Position < DirtyMin) ? Position : DirtyMin;
+        DirtyMax = (Position > DirtyMax) ? Position : DirtyMax;
+    }
+    *MemSymbol = Character;
+}
+
+void MoveMemHead(char Direction) {
+    if (Direction == 'L') {
+        CurrMemPosition--;
+        if (CurrMemPosition < MemoryTape.Min) {
+            TapeReserve(CurrMemPosition);
+        }
+    } else if (Direction == 'R') {
+        CurrMemPosition++;
+        if (CurrMemPosition > MemoryTape.Max) {
+            TapeReserve(CurrMemPosition);
+        }
+    } else if (Direction == 'S') {
+
+    } else {
+        printf("Invalid direction!\n");
+    }
+}
+
+Cell * TapeCell(long Position) {
+    if (Position >= 0) {
+        return &MemoryTape.Right.Cells[Position];
+    }
+    return &MemoryTape.Left.Cells[-1 - Position];
+}
+
+char * TapeSymbol(long Position) {
+    if (Position >= 0) {
+        return &MemoryTape.Right.Symbols[Position];
+    }
+    return &MemoryTape.Left.Symbols[-1 - Position];
+}
+
+// Makes [Position] part of touched window, growing its half tape if needed
+void TapeReserve(long Position) {
+    if (Position >= 0) {
+        if (Position >= MemoryTape.Right.Size) {
+            HalfTapeGrow(&MemoryTape.Right, Position);
+        }
+    } else if (-1 - Position >= MemoryTape.Left.Size) {
+        HalfTapeGrow(&MemoryTape.Left, -1 - Position);
+    }
+
+    if (MemoryTape.Max < MemoryTape.Min) {
+        MemoryTape.Min = Position;
+        MemoryTape.Max = Position;
+    } else if (Position < MemoryTape.Min) {
+        MemoryTape.Min = Position;
+    } else if (Position > MemoryTape.Max) {
+        MemoryTape.Max = Position;
+    }
+}
+
+// Doubles [T] until cell nr. [Index] fits in it. New cells are blank
+void HalfTapeGrow(HalfTape * T, long Index) {
+    long NewSize = (T->Size == 0) ? 64 : T->Size * 2;
+
+    while (NewSize <= Index) {
+        NewSize *= 2;
+    }
+
+    T->Symbols = LargeRealloc(T->Symbols, (size_t) NewSize);
+    T->Cells = LargeRealloc(T->Cells, sizeof(Cell) * (size_t) NewSize);
+    memset(T->Symbols + T->Size, '_', (size_t) (NewSize - T->Size));
+    memset(T->Cells + T->Size, 0xFF, sizeof(Cell) * (size_t) (NewSize - T->Size));
+    T->Size = NewSize;
+}
+
+// Pushes a new branch. [Trace] holds its trace fields, if tracing. [Snap] is its tape if it can't be rebuilt
+// from symbol versions (NULL otherwise)
+void StackPush(char Write, unsigned char Move, const uint64_t * Targets, const StackElem * Trace, Snapshot * Snap) {
+    StackElem * NewElem = malloc(sizeof(StackElem) + sizeof(uint64_t) * SetWords);
+    NewElem->Next = Stack;
+    NewElem->MemPositionBuffer = CurrMemPosition;
+    NewElem->BranchID = CurrBranchID;
+    NewElem->MovesBuffer = Moves;
+    NewElem->Write = Write;
+    NewElem->Move = Move;
+    memcpy(NewElem->Targets, Targets, sizeof(uint64_t) * SetWords);
+    NewElem->Snap = Snap;
+    NewElem->TraceParent = TraceLast;
+    if (Trace != NULL) {
+        NewElem->TraceState = Trace->TraceState;
+        NewElem->TraceStates = Trace->TraceStates;
+        NewElem->TraceImplied = Trace->TraceImplied;
+    }
+    NewElem->TapeHash[0] = TapeHash[0];
+    NewElem->TapeHash[1] = TapeHash[1];
+
+    if (Snap != NULL) {
+        Snap->RefCount++;
+    }
+
+    if (Scheduler != LifoScheduler) {
+        LastGroup[LastGroupCount++] = NewElem;
+        HeapPush(NewElem);
+        return;
+    }
+
+    Stack = NewElem;
+
+    FrontierCount++;
+    NewElem->FrontierCharge = StackElemBytes(NewElem);
+    FrontierBytes += NewElem->FrontierCharge;
+    if (FrontierBudget > 0 && FrontierBytes > FrontierBudget) {
+        SpillFrontier();
+    }
+}
+
+StackElem * StackPop() {
+    if (Scheduler != LifoScheduler) {
+        return HeapPop();
+    }
+
+    if (Stack == NULL && SpillBatchCount > 0) {
+        PageInFrontier();
+    }
+
+    if (Stack != NULL) {
+        StackElem * PoppedElem = Stack;
+        Stack = Stack->Next;
+        FrontierCount--;
+        FrontierBytes -= PoppedElem->FrontierCharge;
+        return PoppedElem;
+    } else return NULL;
+}
+
+// Memory used by [Elem], with its share of snapshot when pushed. Snapshot shares change as elements sharing it
+// come and go, so every element takes back what it was charged (FrontierCharge)
+size_t StackElemBytes(const StackElem * Elem) {
+    return sizeof(StackElem) + sizeof(uint64_t) * SetWords + SnapshotBytes(Elem->Snap);
+}
+
+void RunInputs() {
+	// Debugging TM setting phase
+    /*TreeNode * DebugTree = TM->root;
+    InOrderTreeWalk(DebugTree);
+    printf("Max moves = %d\n", Moves);*/
+
+    size_t TapeLength;
+
+    if (BatchTimeout != 0) {
+        // Clock starts here, so that parsing the machine doesn't count against the deadline
+        BatchDeadline = Now() + BatchTimeout;
+        RunScheduledInputs();
+        return;
+    }
+    if (Pipelined == true) {
+        RunPipelinedInputs();
+        return;
+    }
+
+    while ((TapeLength = ReadTape()) != 0) {
+        PrintResult(RunInput(TapeBuffer, TapeLength));
+    }
+}
+
+// Reads every tape before running them from the shortest one, so that under a batch deadline
+// the cheap tapes are done first. Results are still printed in input order
+void RunScheduledInputs() {
+    PendingTape * Tapes = NULL;
+    PendingTape ** Order;
+    size_t Count = 0, Capacity = 0, i;
+    size_t TapeLength;
+
+    while ((TapeLength = ReadTape()) != 0) {
+        if (Count == Capacity) {
+            Capacity = Capacity == 0 ? 64 : Capacity * 2;
+            Tapes = realloc(Tapes, sizeof(PendingTape) * Capacity);
+        }
+
+        Tapes[Count].Input = malloc(TapeLength);
+        memcpy(Tapes[Count].Input, TapeBuffer, TapeLength);
+        Tapes[Count].Length = TapeLength;
+        Tapes[Count].Position = Count;
+        Count++;
+    }
+
+    Order = malloc(sizeof(PendingTape *) * (Count + 1));
+    for (i = 0; i < Count; i++) {
+        Order[i] = &Tapes[i];
+    }
+    qsort(Order, Count, sizeof(PendingTape *), CompareTapeLength);
+
+    for (i = 0; i < Count; i++) {
+        if (Now() >= BatchDeadline) {
+            Order[i]->Result = 3;
+        } else {
+            Order[i]->Result = RunInput(Order[i]->Input, Order[i]->Length);
+        }
+    }
+
+    for (i = 0; i < Count; i++) {
+        PrintResult(Tapes[i].Result);
+        free(Tapes[i].Input);
+    }
+
+    free(Order);
+    free(Tapes);
+}
+
+// Reads tapes, simulates them and writes their results in three stages, so that I/O overlaps with simulation.
+// Simulation runs on calling thread, as engines keep their state in globals
+void RunPipelinedInputs() {
+    pthread_t Reader, Writer;
+    PendingTape * Tape;
+
+    RingInit(&ReadRing);
+    RingInit(&WriteRing);
+    if (pthread_create(&Reader, NULL, ReaderStage, NULL) != 0 || pthread_create(&Writer, NULL, WriterStage, NULL) != 0) {
+        fprintf(stderr, "ERROR: Cannot start pipeline threads\n");
+        exit(1);
+    }
+
+    while ((Tape = RingPop(&ReadRing)) != NULL) {
+        Tape->Result = RunInput(Tape->Input, Tape->Length);
+        RingPush(&WriteRing, Tape);
+    }
+    RingPush(&WriteRing, NULL);
+
+    pthread_join(Reader, NULL);
+    pthread_join(Writer, NULL);
+    RingDestroy(&ReadRing);
+    RingDestroy(&WriteRing);
+}
+
+// Reads tapes in their own buffers, then pushes NULL once input is over
+void * ReaderStage(void * Arg) {
+    size_t TapeLength;
+
+    (void) Arg;
+    while ((TapeLength = ReadTape()) != 0) {
+        PendingTape * Tape = malloc(sizeof(PendingTape));
+
+        Tape->Input = malloc(TapeLength);
+        memcpy(Tape->Input, TapeBuffer, TapeLength);
+        Tape->Length = TapeLength;
+        RingPush(&ReadRing, Tape);
+    }
+    RingPush(&ReadRing, NULL);
+
+    return NULL;
+}
+
+// Prints results as they come. There is a single simulator and both rings are FIFO, so they come in input order
+void * WriterStage(void * Arg) {
+    PendingTape * Tape;
+    int Ready;
+
+    (void) Arg;
+    while ((Tape = RingPop(&WriteRing)) != NULL) {
+        PrintResult(Tape->Result);
+        free(Tape->Input);
+        free(Tape);
+
+        // Results are flushed whenever simulator stage has nothing else ready, for readers downstream of a pipe
+        if (sem_getvalue(&WriteRing.Filled, &Ready) == 0 && Ready == 0) {
+            fflush(stdout);
+        }
+    }
+    fflush(stdout);
+
+    return NULL;
+}
+
+void RingInit(TapeRing * Ring) {
+    Ring->Head = 0;
+    Ring->Tail = 0;
+    sem_init(&Ring->Filled, 0, 0);
+    sem_init(&Ring->Free, 0, RINGSIZE);
+}
+
+// Waits for a free slot, then pushes [Tape]
+void RingPush(TapeRing * Ring, PendingTape * Tape) {
+    while (sem_wait(&Ring->Free) != 0);
+    Ring->Slots[Ring->Tail] = Tape;
+    Ring->Tail = (Ring->Tail + 1) % RINGSIZE;
+    sem_post(&Ring->Filled);
+}
+
+// Waits for a filled slot, then pops its tape
+PendingTape * RingPop(TapeRing * Ring) {
+    PendingTape * Tape;
+
+    while (sem_wait(&Ring->Filled) != 0);
+    Tape = Ring->Slots[Ring->Head];
+    Ring->Head = (Ring->Head + 1) % RINGSIZE;
+    sem_post(&Ring->Free);
+
+    return Tape;
+}
+
+void RingDestroy(TapeRing * Ring) {
+    sem_destroy(&Ring->Filled);
+    sem_destroy(&Ring->Free);
+}
+
+// Shortest tapes first, input order between tapes of same length
+int CompareTapeLength(const void * a, const void * b) {
+    const PendingTape * TapeA = *(PendingTape * const *) a;
+    const PendingTape * TapeB = *(PendingTape * const *) b;
+
+    if (TapeA->Length != TapeB->Length) {
+        return TapeA->Length < TapeB->Length ? -1 : 1;
+    }
+    return TapeA->Position < TapeB->Position ? -1 : 1;
+}
+
+// Gets result of [Input] from cache, or simulates it within its time limits. Timed out results are never cached
+int RunInput(const char * Input, size_t Length) {
+    int Result;
+    CacheRecord Key;
+
+    if (TrackCount > 1) {
+        ExpandTrackInputs(Input, Length);
+    }
+
+    Key.Fingerprint = MachineFingerprint;
+    Key.TapeHash = HashBytes(FNVOFFSET, Input, Length);
+    Key.TapeCheck = HashWords(Input, Length);
+    Key.MaxMoves = MaxMoves;
+    Key.TapeLength = Length;
+    Key.Padding = 0;
+
+    if (TraceFile != NULL) {
+        TraceTapeStart(Input, Length);
+    }
+
+    if (Cache != NULL && CacheLookup(Cache, &Key) == true) {
+        if (TraceFile != NULL) {
+            TraceAppend(TraceResult, 0, 0, 0, (uint32_t) Key.Result, 0, TRACENOPARENT);
+        }
+        return Key.Result;
+    }
+
+    TapeDeadline = 0;
+    if (TapeTimeout != 0) {
+        TapeDeadline = Now() + TapeTimeout;
+    }
+    if (BatchDeadline != 0 && (TapeDeadline == 0 || BatchDeadline < TapeDeadline)) {
+        TapeDeadline = BatchDeadline;
+    }
+    StepsToCheck = TIMECHECKSTEPS;
+
+    Result = SimulateTape(Input, Length);
+
+    if (TraceFile != NULL) {
+        TraceAppend(TraceResult, 0, 0, 0, (uint32_t) Result, 0, TraceLast);
+    }
+
+    if (Cache != NULL && Result != 3) {
+        Key.Result = Result;
+        CacheStore(Cache, &Key);
+    }
+
+    return Result;
+}
+
+void PrintResult(int Result) {
+    if (Result == 1 || Result == 0) {
+        printf("%d\n", Result);
+    } else if (Result == 2) {
+        printf("%c\n", 'U');
+    } else if (Result == 3) {
+        printf("%c\n", 'T');
+    }
+}
+
+// Monotonic time in nanoseconds
+uint64_t Now() {
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + (uint64_t) Time.tv_nsec;
+}
+
+// Checked every TIMECHECKSTEPS steps, true if current tape is past its deadline
+bool TimedOut() {
+    StepsToCheck = TIMECHECKSTEPS;
+    return TapeDeadline != 0 && Now() >= TapeDeadline;
+}
+
+void InitStack() {
+    uint32_t FirstState = SearchNode(TM, TM->root, 0)->StatePtr->Index;
+    int AreMovesOver = 0;
+
+    // First state isn't checked for acceptance before moving, so its self loops are pushed too
+    PushState(FirstState, *TapeSymbol(0), &AreMovesOver, false);
+}
+
+// Runs the machine on [Input]. Returns 1 if accepted, 0 if not, 2 if undetermined, 3 if timed out
+int SimulateTape(const char * Input, size_t Length) {
+    if (TapeCount > 1) {
+        return RunMultiTape(Input, Length);
+    }
+
+    if (Engine == AutoEngine) {
+        int Result = DeterministicEngine(Input, Length);
+
+        if (TraceFile != NULL) {
+            TraceDeterministicRun();
+        }
+        return Result;
+    }
+
+    return RunGeneral(Input, Length);
+}
+
+// Runs the machine on [Input] with the branching engine
+int RunGeneral(const char * Input, size_t Length) {
+    int Result;
+
+    InitTape(Input, Length);
+    InitStack();
+
+    Result = RunTM(0);
+
+    ResetMemory();
+    return Result;
+}
+
+// Runs the machine on a flat tape with no branch bookkeeping, as long as every reached state
+// has at most one transition for the read symbol. Falls back to branching engine otherwise
+int RunDeterministic(const char * Input, size_t Length) {
+    FlatTape * T = &DetTape;
+    State * CurrentState = SearchNode(TM, TM->root, 0)->StatePtr;
+    PackedTransition * CurrTransition;
+    unsigned long int MovesLeft = Moves;
+    long Head = 0;
+    int AreMovesOver = 0;
+    int Key;
+
+    FlatTapeLoad(T, Input, Length);
+
+    Key = SearchReadSymbol(CurrentState, T->Symbols[T->Origin]);
+    if (Key < 0) {
+        return 0;
+    }
+    if (CurrentState->FirstTransition[Key + 1] - CurrentState->FirstTransition[Key] > 1) {
+        return RunGeneral(Input, Length);
+    }
+
+    CurrTransition = &Packed[CurrentState->FirstTransition[Key]];
+    while (true) {
+        if (TransitionHits != NULL) {
+            TransitionHits[CurrTransition - Packed]++;
+        }
+
+        // Exec transition
+        T->Symbols[T->Origin + Head] = CurrTransition->Write;
+        if (CurrTransition->Move == MoveRight) {
+            Head++;
+            if (Head > T->Max) {
+                if (T->Origin + Head >= T->Size) {
+                    FlatTapeGrow(T, Head);
+                }
+                T->Max = Head;
+            }
+        } else if (CurrTransition->Move == MoveLeft) {
+            Head--;
+            if (Head < T->Min) {
+                if (T->Origin + Head < 0) {
+                    FlatTapeGrow(T, Head);
+                }
+                T->Min = Head;
+            }
+        }
+        CurrentState = States[CurrTransition->ToState];
+        MovesLeft--;
+        DetMovesLeft = MovesLeft;
+
+        if (--StepsToCheck == 0 && TimedOut() == true) {
+            return 3;
+        }
+
+        // Acceptance is checked before looking for next transitions
+        if (MovesLeft <= 0) {
+            return 2;
+        } else if ((AcceptMask[CurrTransition->ToState / 64] >> (CurrTransition->ToState % 64) & 1) != 0) {
+            return 1;
+        }
+
+        char Input = T->Symbols[T->Origin + Head];
+        Key = SearchReadSymbol(CurrentState, Input);
+
+        if (Key < 0) {
+            return AreMovesOver;
+        }
+        if (CurrentState->AcceptDistance[Key] < MovesLeft) {
+            return 1;
+        }
+
+        uint32_t First = CurrentState->FirstTransition[Key];
+
+        if (CurrentState->FirstTransition[Key + 1] - First > 1) {
+            Moves = MovesLeft;
+            return ResumeGeneral(CurrentState, Key, Head);
+        }
+
+        if (Packed[First].Move == MoveStay && Packed[First].Write == Input && Packed[First].ToState == CurrentState->Index) {
+            return 2;
+        }
+        CurrTransition = &Packed[CurrentState->FirstTransition[Key]];
+    }
+}
+
+// Dispatch of dense engines: with GCC computed gotos every handler jumps to the next one by itself,
+// otherwise through a switch
+#ifdef __GNUC__
+#define DENSE_HANDLERS static void * const Handlers[] = {&&LeftHandler, &&RightHandler, &&StayHandler, &&NoneHandler, &&SlowHandler, &&LoopHandler};
+#define DENSE_DISPATCH(Handler) goto * Handlers[Handler]
+#else
+#define DENSE_HANDLERS
+#define DENSE_DISPATCH(Handler) \
+        switch (Handler) { \
+            case MoveLeft: goto LeftHandler; \
+            case MoveRight: goto RightHandler; \
+            case MoveStay: goto StayHandler; \
+            case DENSENONE: goto NoneHandler; \
+            case DENSESLOW: goto SlowHandler; \
+            default: goto LoopHandler; \
+        }
+#endif
+
+// Checks that follow every move of a dense engine, then dispatches the next step
+#define DENSE_STEP(Alphabet) \
+        CurrIndex = (uint32_t) Step; \
+        MovesLeft--; \
+ \
+        if (--Steps == 0) { \
+            DENSE_SYNC(); \
+            if (TimedOut() == true) { \
+                return 3; \
+            } \
+            Steps = StepsToCheck; \
+        } \
+        if (MovesLeft <= 0) { \
+            DENSE_SYNC(); \
+            return 2; \
+        } else if ((Accept[CurrIndex / 64] >> (CurrIndex % 64) & 1) != 0) { \
+            DENSE_SYNC(); \
+            return 1; \
+        } \
+ \
+        Read = (unsigned char) Symbols[Head]; \
+        Step = Dense[(size_t) CurrIndex * Alphabet + (Alphabet == 256 ? Read : SymbolCode[Read])]; \
+        DENSE_DISPATCH(Step >> 40);
+
+// Writes back what a dense engine keeps in locals
+#define DENSE_SYNC() \
+        T->Min = Min; \
+        T->Max = Max; \
+        StepsToCheck = Steps; \
+        DetMovesLeft = MovesLeft;
+
+// Deterministic engine specialized for machines of [Alphabet] symbol codes at most. Same as RunDeterministic, but transitions are pre-decoded in DenseNext, so that a single table
+// load gives what every move writes, where it goes and the handler that runs it. Head, state, moves left and
+// tape window stay in locals, as stores on tape could alias globals
+#define DEFINE_DENSE_ENGINE(Name, Alphabet) \
+int Name(const char * Input, size_t Length) { \
+    DENSE_HANDLERS \
+    FlatTape * T = &DetTape; \
+    State * CurrentState = SearchNode(TM, TM->root, 0)->StatePtr; \
+    const uint64_t * const Dense = DenseNext; \
+    const uint64_t * const Accept = AcceptMask; \
+    unsigned long int MovesLeft = Moves; \
+    unsigned int Steps = StepsToCheck; \
+    long Head = 0, Min, Max; \
+    char * Symbols; \
+    uint32_t CurrIndex = 0, First; \
+    unsigned char Read = 0; \
+    uint64_t Step; \
+    int Key; \
+ \
+    FlatTapeLoad(T, Input, Length); \
+    Symbols = T->Symbols + T->Origin; \
+    Min = T->Min; \
+    Max = T->Max; \
+ \
+    Key = SearchReadSymbol(CurrentState, Symbols[0]); \
+    if (Key < 0) { \
+        return 0; \
+    } \
+    if (CurrentState->FirstTransition[Key + 1] - CurrentState->FirstTransition[Key] > 1) { \
+        return RunGeneral(Input, Length); \
+    } \
+ \
+    First = CurrentState->FirstTransition[Key]; \
+    Step = DENSESTEP(Packed[First].ToState, Packed[First].Write, Packed[First].Move); \
+    DENSE_DISPATCH(Step >> 40); \
+ \
+LeftHandler: \
+    Symbols[Head] = (char) (Step >> 32); \
+    Head--; \
+    if (Head < Min) { \
+        if (T->Origin + Head < 0) { \
+            DENSE_SYNC(); \
+            FlatTapeGrow(T, Head); \
+            Symbols = T->Symbols + T->Origin; \
+        } \
+        Min = Head; \
+    } \
+    DENSE_STEP(Alphabet) \
+ \
+RightHandler: \
+    Symbols[Head] = (char) (Step >> 32); \
+    Head++; \
+    if (Head > Max) { \
+        if (T->Origin + Head >= T->Size) { \
+            DENSE_SYNC(); \
+            FlatTapeGrow(T, Head); \
+            Symbols = T->Symbols + T->Origin; \
+        } \
+        Max = Head; \
+    } \
+    DENSE_STEP(Alphabet) \
+ \
+StayHandler: \
+    Symbols[Head] = (char) (Step >> 32); \
+    DENSE_STEP(Alphabet) \
+ \
+NoneHandler: \
+    DENSE_SYNC(); \
+    return 0; \
+ \
+LoopHandler: \
+    DENSE_SYNC(); \
+    return 2; \
+ \
+SlowHandler: \
+    DENSE_SYNC(); \
+    CurrentState = States[CurrIndex]; \
+    Key = SearchReadSymbol(CurrentState, (char) Read); \
+    if (CurrentState->AcceptDistance[Key] < MovesLeft) { \
+        return 1; \
+    } \
+    if (CurrentState->FirstTransition[Key + 1] - CurrentState->FirstTransition[Key] > 1) { \
+        Moves = MovesLeft; \
+        return ResumeGeneral(CurrentState, Key, Head); \
+    } \
+    First = CurrentState->FirstTransition[Key]; \
+    if (Packed[First].Move == MoveStay && Packed[First].Write == (char) Read && Packed[First].ToState == CurrIndex) { \
+        return 2; \
+    } \
+    Step = DENSESTEP(Packed[First].ToState, Packed[First].Write, Packed[First].Move); \
+    DENSE_DISPATCH(Step >> 40); \
+}
+
+DEFINE_DENSE_ENGINE(RunDense4, 4)
+DEFINE_DENSE_ENGINE(RunDense16, 16)
+DEFINE_DENSE_ENGINE(RunDense256, 256)
+
+// Picks the tightest dense engine for machine alphabet, and fills its table.
+// Profiled runs, and machines whose table would be too big, keep RunDeterministic
+void SelectEngine() {
+    bool Used[256];
+    unsigned int Codes = 1, Alphabet, s, k, c;
+
+    DeterministicEngine = RunDeterministic;
+    if (TransitionHits != NULL || TapeCount > 1) {
+        return;
+    }
+
+    // Code 0 is for symbols the machine never reads nor writes
+    memset(Used, 0, sizeof(Used));
+    memset(SymbolCode, 0, sizeof(SymbolCode));
+    Used['_'] = true;
+    for (s = 0; s < StateCount; s++) {
+        for (k = 0; k < States[s]->KeyCount; k++) {
+            uint32_t t;
+
+            Used[(unsigned char) States[s]->Keys[k]] = true;
+            for (t = States[s]->FirstTransition[k]; t < States[s]->FirstTransition[k + 1]; t++) {
+                Used[(unsigned char) Packed[t].Write] = true;
+            }
+        }
+    }
+    for (c = 0; c < 256; c++) {
+        if (Used[c] == true) {
+            SymbolCode[c] = (unsigned char) ((Codes < 256) ? Codes : 0);
+            Codes++;
+        }
+    }
+
+    Alphabet = (Codes <= 4) ? 4 : (Codes <= 16) ? 16 : 256;
+    if ((size_t) StateCount * Alphabet * sizeof(uint64_t) > DENSEMAXBYTES) {
+        return;
+    }
+
+    DenseNext = LargeAlloc(sizeof(uint64_t) * StateCount * Alphabet);
+    for (s = 0; s < StateCount; s++) {
+        for (c = 0; c < Alphabet; c++) {
+            DenseNext[(size_t) s * Alphabet + c] = DENSESTEP(0, 0, DENSENONE);
+        }
+
+        for (k = 0; k < States[s]->KeyCount; k++) {
+            unsigned char Read = (unsigned char) States[s]->Keys[k];
+            uint32_t First = States[s]->FirstTransition[k];
+            uint64_t Next = DENSESTEP(Packed[First].ToState, Packed[First].Write, Packed[First].Move);
+
+            if (States[s]->FirstTransition[k + 1] - First > 1 || States[s]->AcceptDistance[k] != NOACCEPT) {
+                Next = DENSESTEP(0, 0, DENSESLOW);
+            } else if (Packed[First].Move == MoveStay && Packed[First].Write == (char) Read && Packed[First].ToState == s) {
+                Next = DENSESTEP(0, 0, DENSELOOP);
+            }
+            DenseNext[(size_t) s * Alphabet + ((Alphabet == 256) ? Read : SymbolCode[Read])] = Next;
+        }
+    }
+
+    if (Alphabet == 4) {
+        DeterministicEngine = RunDense4;
+    } else if (Alphabet == 16) {
+        DeterministicEngine = RunDense16;
+    } else {
+        DeterministicEngine = RunDense256;
+    }
+}
+
+// Moves content of flat tape on memory tape and continues from [CurrentState] with branching engine
+int ResumeGeneral(State * CurrentState, int Key, long Head) {
+    FlatTape * T = &DetTape;
+    int AreMovesOver = 0;
+    int Result;
+
+    if (TraceFile != NULL) {
+        TraceDeterministicRun();
+    }
+
+    LoadTape(T->Symbols + T->Origin + T->Min, (size_t) (T->Max - T->Min + 1), T->Min);
+    CurrMemPosition = Head;
+
+    if (PushState(CurrentState->Index, CurrentState->Keys[Key], &AreMovesOver, true) == true) {
+        Result = 1;
+    } else {
+        Result = RunTM(AreMovesOver);
+    }
+
+    ResetMemory();
+    return Result;
+}
+
+// Clears memory tape, stack and moves after a run of branching engine
+void ResetMemory() {
+    FreeStack();
+    if (Visited != NULL) {
+        VisitedNextTape(Visited);
+    }
+
+    Moves = MaxMoves;
+    ResetTape();
+}
+
+// Blanks every touched cell of memory tape, leaving head on position 0
+void ResetTape() {
+    long Left = (MemoryTape.Min < 0) ? -MemoryTape.Min : 0;
+    long Right = (MemoryTape.Max >= 0) ? MemoryTape.Max + 1 : 0;
+
+    CurrBranchID = 0;
+    FlushMemorySymbols(-1);
+
+    // Once every version is undone cells are as blank ones, only symbols are left
+    if (MemoryTape.Max >= MemoryTape.Min) {
+        memset(MemoryTape.Left.Symbols, '_', (size_t) Left);
+        memset(MemoryTape.Right.Symbols, '_', (size_t) Right);
+    }
+
+    MemoryTape.Min = 0;
+    MemoryTape.Max = -1;
+    TapeReserve(0);
+    CurrMemPosition = 0;
+    TapeHash[0] = 0;
+    TapeHash[1] = 0;
+
+    ReleaseSnapshot(LiveBase);
+    LiveBase = NULL;
+    DirtyMin = __LONG_MAX__;
+    DirtyMax = -__LONG_MAX__ - 1;
+}
+
+// Allocates a block that may grow large (machine image, tapes, write log). Without -H it's malloc. With -H,
+// blocks of a quarter of a huge page or more are anonymous mappings: explicit 2 MB pages if the system
+// has some reserved, otherwise transparent huge pages requested with madvise. The mapped length (0 for
+// blocks from malloc) and the size are kept in a header before the block. Exits if memory is over
+void * LargeAlloc(size_t Size) {
+    size_t Length = (Size + LARGEHEADER + HUGEPAGESIZE - 1) & ~(HUGEPAGESIZE - 1);
+    char * Base;
+
+    if (HugePages == false) {
+        if ((Base = malloc(Size > 0 ? Size : 1)) == NULL) {
+            LargeAllocFailed(Size);
+        }
+        return Base;
+    }
+
+    if (Size < HUGEPAGESIZE / 4) {
+        Base = aligned_alloc(LARGEHEADER, (Size + 2 * LARGEHEADER - 1) & ~(size_t) (LARGEHEADER - 1));
+        if (Base == NULL) {
+            LargeAllocFailed(Size);
+        }
+        ((size_t *) Base)[0] = 0;
+        ((size_t *) Base)[1] = Size;
+        return Base + LARGEHEADER;
+    }
+
+    Base = mmap(NULL, Length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (Base != MAP_FAILED) {
+        HugeMappings[0]++;
+    } else {
+        Base = mmap(NULL, Length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (Base == MAP_FAILED) {
+            LargeAllocFailed(Size);
+        }
+        madvise(Base, Length, MADV_HUGEPAGE);
+        HugeMappings[1]++;
+    }
+
+    ((size_t *) Base)[0] = Length;
+    ((size_t *) Base)[1] = Size;
+    return Base + LARGEHEADER;
+}
+
+void LargeAllocFailed(size_t Size) {
+    fprintf(stderr, "ERROR: Cannot allocate %zu bytes\n", Size);
+    exit(1);
+}
+
+// Resizes a block of LargeAlloc, as realloc. Exits if memory is over
+void * LargeRealloc(void * Block, size_t Size) {
+    size_t * Header;
+    void * NewBlock;
+
+    if (HugePages == false) {
+        if ((NewBlock = realloc(Block, Size > 0 ? Size : 1)) == NULL) {
+            LargeAllocFailed(Size);
+        }
+        return NewBlock;
+    }
+    if (Block == NULL) {
+        return LargeAlloc(Size);
+    }
+
+    Header = (size_t *) ((char *) Block - LARGEHEADER);
+    if (Header[0] != 0 && Size <= Header[0] - LARGEHEADER) {
+        Header[1] = Size;
+        return Block;
+    }
+
+    NewBlock = LargeAlloc(Size);
+    memcpy(NewBlock, Block, Size < Header[1] ? Size : Header[1]);
+    LargeFree(Block);
+    return NewBlock;
+}
+
+void LargeFree(void * Block) {
+    size_t Length;
+
+    if (HugePages == false || Block == NULL) {
+        free(Block);
+        return;
+    }
+
+    Length = *(size_t *) ((char *) Block - LARGEHEADER);
+    if (Length == 0) {
+        free((char *) Block - LARGEHEADER);
+    } else {
+        munmap((char *) Block - LARGEHEADER, Length);
+    }
+}
+
+// Opens dTLB load misses and cycles counters of this process, user space only. Counters the kernel doesn't
+// give are left closed
+void PerfStart() {
+    struct perf_event_attr Attr;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        memset(&Attr, 0, sizeof(Attr));
+        Attr.size = sizeof(Attr);
+        if (i == 0) {
+            Attr.type = PERF_TYPE_HW_CACHE;
+            Attr.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        } else {
+            Attr.type = PERF_TYPE_HARDWARE;
+            Attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        }
+        Attr.exclude_kernel = 1;
+        Attr.exclude_hv = 1;
+
+        if (PerfCounters[i] < 0) {
+            PerfCounters[i] = (int) syscall(SYS_perf_event_open, &Attr, 0, -1, -1, 0);
+        }
+    }
+}
+
+// Prints page sizes used and counters on stderr
+void PerfReport() {
+    const char * Names[2] = {"dTLB load misses", "cycles"};
+    uint64_t Count;
+    int i;
+
+    if (PerfCounters[0] < 0 && PerfCounters[1] < 0 && HugePages == false) {
+        return;
+    }
+
+    fprintf(stderr, "Pages: %s, %llu explicit and %llu transparent huge page mappings\n", HugePages == true ? "huge" : "small",
+            (unsigned long long) HugeMappings[0], (unsigned long long) HugeMappings[1]);
+    for (i = 0; i < 2; i++) {
+        if (PerfCounters[i] >= 0 && read(PerfCounters[i], &Count, sizeof(Count)) == sizeof(Count)) {
+            fprintf(stderr, "%s: %llu\n", Names[i], (unsigned long long) Count);
+        } else {
+            fprintf(stderr, "%s: unavailable\n", Names[i]);
+        }
+        if (PerfCounters[i] >= 0) {
+            close(PerfCounters[i]);
+        }
+    }
+}
+
+// Writes [Input] on flat tape from position 0, blanking what was written by previous runs
+void FlatTapeLoad(FlatTape * T, const char * Input, size_t Length) {
+    if (T->Max >= T->Min) {
+        memset(T->Symbols + T->Origin + T->Min, '_', (size_t) (T->Max - T->Min + 1));
+    }
+
+    if (T->Size < (long) Length + 2) {
+        LargeFree(T->Symbols);
+        T->Size = (long) Length * 2 + 2;
+        T->Symbols = LargeAlloc((size_t) T->Size);
+        memset(T->Symbols, '_', (size_t) T->Size);
+    }
+
+    T->Origin = (T->Size - (long) Length) / 2;
+    memcpy(T->Symbols + T->Origin, Input, Length);
+    T->Min = 0;
+    T->Max = (long) Length - 1;
+}
+
+// Doubles flat tape size so that [Position] fits in it, keeping content centered
+void FlatTapeGrow(FlatTape * T, long Position) {
+    long NewSize = T->Size * 2;
+    long Used = T->Max - T->Min + 1;
+    char * NewSymbols;
+    long NewOrigin;
+
+    while (Used + (Position < T->Min ? T->Min - Position : Position - T->Max) + 2 > NewSize) {
+        NewSize *= 2;
+    }
+
+    NewSymbols = LargeAlloc((size_t) NewSize);
+    memset(NewSymbols, '_', (size_t) NewSize);
+    NewOrigin = (NewSize - Used) / 2 - T->Min;
+    memcpy(NewSymbols + NewOrigin + T->Min, T->Symbols + T->Origin + T->Min, (size_t) Used);
+
+    LargeFree(T->Symbols);
+    T->Symbols = NewSymbols;
+    T->Size = NewSize;
+    T->Origin = NewOrigin;
+}
+
+// Runs multi-tape machine on [Input], written on first tape. Branches are explored depth first as in
+// branching engine, but on flat tapes: writes are kept on a trail and undone when backtracking
+int RunMultiTape(const char * Input, size_t Length) {
+    long Heads[MAXTAPES] = {0};
+    char Read[MAXTAPES] = {0};
+    unsigned long int MovesLeft;
+    int AreMovesOver = 0;
+    uint32_t First, Last, CurrState = States[0]->Index;
+    unsigned int t;
+
+    FlatTapeLoad(&MultiTapes[0], Input, Length);
+    for (t = 1; t < TapeCount; t++) {
+        FlatTapeLoad(&MultiTapes[t], "_", 1);
+    }
+    TapesStackSize = 0;
+    TrailLength = 0;
+
+    // First transitions, with the same range search used after every step
+    for (t = 0; t < TapeCount; t++) {
+        Read[t] = MultiTapes[t].Symbols[MultiTapes[t].Origin];
+    }
+    for (First = TapesFirst[CurrState]; First < TapesFirst[CurrState + 1] && memcmp(TapesTransitions[First].Read, Read, MAXTAPES) < 0; First++);
+    for (Last = First; Last < TapesFirst[CurrState + 1] && memcmp(TapesTransitions[Last].Read, Read, MAXTAPES) == 0; Last++);
+    PushTapesBranches(First, Last, Heads, MaxMoves);
+
+    while (TapesStackSize > 0) {
+        TapesBranch * Branch = &TapesStack[--TapesStackSize];
+        TapesTransition * CurrTransition = &TapesTransitions[Branch->Trans];
+
+        // Back to tape of branch
+        while (TrailLength > Branch->TrailLength) {
+            TapesWrite * Undo = &Trail[--TrailLength];
+            MultiTapes[Undo->Tape].Symbols[MultiTapes[Undo->Tape].Origin + Undo->Position] = Undo->Symbol;
+        }
+        memcpy(Heads, Branch->Heads, sizeof(Heads));
+        MovesLeft = Branch->MovesLeft;
+
+        // Exec transition
+        for (t = 0; t < TapeCount; t++) {
+            FlatTape * T = &MultiTapes[t];
+            char * Symbol = &T->Symbols[T->Origin + Heads[t]];
+
+            if (*Symbol != CurrTransition->Write[t]) {
+                if (TrailLength == TrailCapacity) {
+                    TrailCapacity = (TrailCapacity == 0) ? 256 : TrailCapacity * 2;
+                    Trail = realloc(Trail, sizeof(TapesWrite) * TrailCapacity);
+                }
+                Trail[TrailLength].Position = Heads[t];
+                Trail[TrailLength].Tape = t;
+                Trail[TrailLength].Symbol = *Symbol;
+                TrailLength++;
+                *Symbol = CurrTransition->Write[t];
+            }
+
+            if (CurrTransition->Move[t] == MoveRight) {
+                Heads[t]++;
+                if (Heads[t] > T->Max) {
+                    if (T->Origin + Heads[t] >= T->Size) {
+                        FlatTapeGrow(T, Heads[t]);
+                    }
+                    T->Max = Heads[t];
+                }
+            } else if (CurrTransition->Move[t] == MoveLeft) {
+                Heads[t]--;
+                if (Heads[t] < T->Min) {
+                    if (T->Origin + Heads[t] < 0) {
+                        FlatTapeGrow(T, Heads[t]);
+                    }
+                    T->Min = Heads[t];
+                }
+            }
+            Read[t] = T->Symbols[T->Origin + Heads[t]];
+        }
+        CurrState = CurrTransition->End;
+        MovesLeft--;
+
+        if (--StepsToCheck == 0 && TimedOut() == true) {
+            return 3;
+        }
+
+        // Update stack with new transitions
+        if (MovesLeft > 0) {
+            for (First = TapesFirst[CurrState]; First < TapesFirst[CurrState + 1] && memcmp(TapesTransitions[First].Read, Read, MAXTAPES) < 0; First++);
+            for (Last = First; Last < TapesFirst[CurrState + 1] && memcmp(TapesTransitions[Last].Read, Read, MAXTAPES) == 0; Last++);
+
+            while (First < Last) {
+                TapesTransition * Next = &TapesTransitions[--Last];
+
+                // Self loops that don't move any head are never pushed, as they would loop until moves are over
+                for (t = 0; t < TapeCount && Next->Move[t] == MoveStay && Next->Write[t] == Read[t]; t++);
+                if (t == TapeCount && Next->End == CurrState) {
+                    AreMovesOver = 2;
+                } else {
+                    PushTapesBranches(Last, Last + 1, Heads, MovesLeft);
+                }
+            }
+        }
+
+        if (MovesLeft <= 0) {
+            AreMovesOver = 2;
+        } else if (States[CurrState]->IsAcceptanceState == true) {
+            return 1;
+        }
+    }
+
+    return AreMovesOver;
+}
+
+// Pushes transitions from [First] to [Last] - 1 as new branches, so that [First] is popped first
+void PushTapesBranches(uint32_t First, uint32_t Last, const long * Heads, unsigned long int MovesLeft) {
+    while (Last > First) {
+        TapesBranch * NewBranch;
+
+        if (TapesStackSize == TapesStackCapacity) {
+            TapesStackCapacity = (TapesStackCapacity == 0) ? 64 : TapesStackCapacity * 2;
+            TapesStack = realloc(TapesStack, sizeof(TapesBranch) * TapesStackCapacity);
+        }
+
+        NewBranch = &TapesStack[TapesStackSize++];
+        NewBranch->Trans = --Last;
+        NewBranch->TrailLength = TrailLength;
+        NewBranch->MovesLeft = MovesLeft;
+        memcpy(NewBranch->Heads, Heads, sizeof(NewBranch->Heads));
+    }
+}
+
+// Reads next input tape into TapeBuffer. Returns its length (0 if there are no input left)
+size_t ReadTape() {
+    int InputSymbol;
+    ssize_t Length = getline(&TapeBuffer, &TapeBufferSize, MachineInput);
+
+    if (Length <= 0) {
+        return 0;
+    }
+    if (TapeBuffer[Length - 1] != '\n') {
+        return (size_t) Length;
+    }
+    if (Length > 1) {
+        return (size_t) Length - 1;
+    }
+
+    // Empty line: its newline is the first symbol of a tape that goes on until the end of next line
+    while ((InputSymbol = getc(MachineInput)) != '\n' && InputSymbol != EOF) {
+        if ((size_t) Length + 1 >= TapeBufferSize) {
+            TapeBufferSize *= 2;
+            TapeBuffer = realloc(TapeBuffer, TapeBufferSize);
+        }
+        TapeBuffer[Length++] = (char) InputSymbol;
+    }
+
+    return (size_t) Length;
+}
+
+// Writes [Input] on memory tape and moves head back to its first symbol
+void InitTape(const char * Input, size_t Length) {
+    LoadTape(Input, Length, 0);
+    CurrMemPosition = 0;
+}
+
+// Writes [Input] on empty memory tape from position [Start], as symbols of branch 0. Symbols are copied in bulk,
+// the right half is in tape order and the left half in reverse order
+void LoadTape(const char * Input, size_t Length, long Start) {
+    long End = Start + (long) Length - 1;
+    long p;
+
+    TapeReserve(Start);
+    TapeReserve(End);
+    DirtyMin = (Start < DirtyMin) ? Start : DirtyMin;
+    DirtyMax = (End > DirtyMax) ? End : DirtyMax;
+
+    for (p = Start; p <= End && p < 0; p++) {
+        MemoryTape.Left.Symbols[-1 - p] = Input[p - Start];
+    }
+    if (p <= End) {
+        memcpy(MemoryTape.Right.Symbols + p, Input + (p - Start), (size_t) (End - p + 1));
+    }
+
+    // Old cells are blank, so only the input symbols count in tape hashes
+    if (Visited != NULL) {
+        for (p = Start; p <= End; p++) {
+            TapeHashCell(p, '_', Input[p - Start]);
+        }
+    }
+}
+
+/*int RunTM(State * CurrentState) {     // Recursive function for RunTM. Delete if not necessary
+    if(Moves <= 0) {
+        return 2;
+    }
+
+    if (CurrentState->IsAcceptanceState == true) {
+        return 1;
+    }
+
+    char ReadMem = CurrMemPosition->Symbol;
+    TransitionList * TransList = SearchReadCharTransList(CurrentState, ReadMem);
+
+    if (TransList == NULL) {
+        return 0;
+    }
+
+    Transition * CurrentTransition = TransList->Transitions;
+    Cell * CurrTmp = CurrMemPosition;
+    char SymbolTmp = CurrMemPosition->Symbol;
+	int ExecResult = 0;
+
+    while (CurrentTransition != NULL) {
+		// Execute transition
+        CurrMemPosition->Symbol = CurrentTransition->Write;
+        MoveMemHead(CurrentTransition->HeadMoveDirection);
+        Moves--;
+
+        ExecResult = RunTM(CurrentTransition->ToState);
+		
+		Moves++;
+		CurrMemPosition = CurrTmp;
+		CurrMemPosition->Symbol = SymbolTmp;
+
+        if (ExecResult == 1) {
+            return ExecResult;
+		}
+
+        CurrentTransition = CurrentTransition->NextTransition;
+    }
+
+    Moves++;
+    CurrMemPosition = CurrTmp;
+    CurrMemPosition->Symbol = SymbolTmp;
+    return ExecResult;
+}*/
+
+int RunTM(int AreMovesOver) {       // Iterative version of RunTM
+    StackElem * CurrStack;
+    char Input = 0;
+    unsigned int w;
+	
+	CurrStack = StackPop();
+
+	if (CurrStack == NULL)
+	{
+		return AreMovesOver;
+	}
+
+    do {
+        // Once a branch ran out of moves, branches that can't accept anymore can only end in 0 or U: dropped
+        if (IsHopeless(CurrStack->Targets, CurrStack->MovesBuffer, AreMovesOver) == true) {
+            if (TraceReplay == true) {
+                TraceDropped();
+            }
+            if (CurrStack->Snap != NULL) {
+                ReleaseSnapshot(CurrStack->Snap);
+            }
+            free(CurrStack);
+            CurrStack = StackPop();
+            continue;
+        }
+
+        if (CurrStack->Snap != NULL) {
+            // Branch paged in from disk: rebuild its tape from scratch
+            ResetTape();
+            LoadSnapshot(CurrStack->Snap);
+            if (Scheduler != LifoScheduler) {
+                // Later snapshots are deltas of this one
+                LiveBase = CurrStack->Snap;
+                LiveBase->RefCount++;
+            }
+            ReleaseSnapshot(CurrStack->Snap);
+			Moves = CurrStack->MovesBuffer;
+            TracePaged = TraceReplay;
+            if (StateBacktracks != NULL) {
+                ProfileBacktrack(CurrStack->Targets);
+            }
+
+        } else if (CurrStack->BranchID <= CurrBranchID){
+            FlushMemorySymbols(CurrStack->BranchID - 1);
+            CurrMemPosition = CurrStack->MemPositionBuffer;
+			Moves = CurrStack->MovesBuffer;
+			CurrBranchID = CurrStack->BranchID;
+            TapeHash[0] = CurrStack->TapeHash[0];
+            TapeHash[1] = CurrStack->TapeHash[1];
+            if (StateBacktracks != NULL) {
+                ProfileBacktrack(CurrStack->Targets);
+            }
+		}
+
+        if (TraceFile != NULL && TraceReplay == false) {
+            Input = *TapeSymbol(CurrMemPosition);
+        }
+
+        // Exec tape effect once for every target state
+		WriteOnTape(CurrMemPosition, CurrStack->Write);
+        MoveMemHead(MoveDirections[CurrStack->Move]);
+        Moves--;
+
+        if (TraceReplay == true) {
+            // Traced with its pushes
+            TraceMoved = true;
+            TraceLast = TraceRecordCount++;
+        } else if (TraceFile != NULL) {
+            TraceLast = TraceMove(Input, CurrStack);
+        }
+
+        if (--StepsToCheck == 0 && TimedOut() == true) {
+            if (TraceMoved == true) {
+                TraceReplayPushes(NULL, 0, false, true);
+            }
+            free(CurrStack);
+            return 3;
+        }
+
+		// Acceptance is checked before any new branch is pushed
+		if (Moves <= 0) {			
+			AreMovesOver = 2;
+		} else {
+			for (w = 0; w < SetWords; w++) {
+				if ((CurrStack->Targets[w] & AcceptMask[w]) != 0) {
+					if (TraceMoved == true) {
+						TraceReplayPushes(NULL, 0, false, true);
+					}
+					free(CurrStack);
+					return 1;
+				}
+			}
+
+			// Update stack with new transitions, unless another branch already reached the same configuration
+			Input = *TapeSymbol(CurrMemPosition);
+			if ((Visited == NULL || VisitedSeen(CurrStack->Targets) == false) &&
+				PushTransitions(CurrStack->Targets, Input, &AreMovesOver, true) == true) {
+				if (TraceMoved == true) {
+					TraceReplayPushes(NULL, 0, false, true);
+				}
+				free(CurrStack);
+				return 1;
+			}
+		}
+
+        // Moves pushing nothing, as moves are over or its configuration was visited, are traced here
+        if (TraceMoved == true) {
+            TraceReplayPushes(NULL, 0, false, true);
+        }
+        free(CurrStack);
+		CurrStack = StackPop();		
+    } while (CurrStack != NULL);
+
+    return AreMovesOver;
+}
+
+// Pushes transitions of states [Set] for read char [Read] as new branches, one for every tape effect
+// (write and move) with the union of the states it leads to. If [SkipLoops], self loops that don't move
+// the head are never pushed, as they would loop until moves are over. Returns true without pushing the
+// rest if a state of [Set] surely accepts within the moves left
+bool PushTransitions(const uint64_t * Set, char Read, int * AreMovesOver, bool SkipLoops) {
+	uint32_t SlotCount = 0, Slot, g, SetStates = 0, Choices = 0, Filled = 0;
+	unsigned int w;
+	int AddedTrans = 0;
+	StackElem Trace;
+
+	CurrentStamp++;
+
+	for (w = 0; w < SetWords; w++) {
+		uint64_t Bits = Set[w];
+
+		for (; Bits != 0; Bits &= Bits - 1) {
+			uint32_t StateIndex = w * 64 + (uint32_t) __builtin_ctzll(Bits);
+			State * CurrentState = States[StateIndex];
+			int Key = SearchReadSymbol(CurrentState, Read);
+
+			SetStates++;
+			if (Key < 0) {
+				continue;
+			}
+			Choices += CurrentState->FirstTransition[Key + 1] - CurrentState->FirstTransition[Key];
+			if (SkipLoops == true && CurrentState->AcceptDistance[Key] < Moves) {
+				return true;
+			}
+
+			if (TransitionHits != NULL) {
+				uint32_t t;
+
+				for (t = CurrentState->FirstTransition[Key]; t < CurrentState->FirstTransition[Key + 1]; t++) {
+					if (SkipLoops == false || Packed[t].Move != MoveStay || Packed[t].Write != Read || Packed[t].ToState != StateIndex) {
+						TransitionHits[t]++;
+					}
+				}
+			}
+
+			for (g = CurrentState->FirstGroup[Key]; g < CurrentState->FirstGroup[Key + 1]; g++) {
+				EffectGroup * Group = &Groups[g];
+				unsigned char WriteIndex = (unsigned char) Group->Write;
+
+				if (EffectStamp[WriteIndex][Group->Move] != CurrentStamp) {
+					if ((SlotCount + 1) * SetWords > EffectSetCapacity) {
+						EffectSetCapacity = (SlotCount + 1) * SetWords * 2;
+						EffectSets = realloc(EffectSets, sizeof(uint64_t) * EffectSetCapacity);
+					}
+					EffectStamp[WriteIndex][Group->Move] = CurrentStamp;
+					EffectSlot[WriteIndex][Group->Move] = SlotCount;
+					SlotWrite[SlotCount] = Group->Write;
+					SlotMove[SlotCount] = Group->Move;
+					SlotLowest[SlotCount] = UINT32_MAX;
+					SlotStates[SlotCount] = 0;
+					memset(EffectSets + SlotCount * SetWords, 0, sizeof(uint64_t) * SetWords);
+					SlotCount++;
+				}
+
+				Slot = EffectSlot[WriteIndex][Group->Move];
+				SetUnion(EffectSets + Slot * SetWords, TargetPool + Group->Targets);
+
+				// States of a slot made of a single group are known, otherwise groups may share some
+				if (TraceFile != NULL && TraceReplay == false && Group->StateCount > 0) {
+					SlotLowest[Slot] = (Group->Lowest < SlotLowest[Slot]) ? Group->Lowest : SlotLowest[Slot];
+					SlotStates[Slot] = (SlotStates[Slot] == 0) ? Group->StateCount : UINT32_MAX;
+				}
+
+				if (Group->HasLoop == true) {
+					if (SkipLoops == true) {
+						*AreMovesOver = 2;
+					} else {
+						EffectSets[Slot * SetWords + w] |= 1ULL << (StateIndex % 64);
+						SlotLowest[Slot] = (StateIndex < SlotLowest[Slot]) ? StateIndex : SlotLowest[Slot];
+						SlotStates[Slot] = UINT32_MAX;
+					}
+				}
+			}
+		}
+	}
+
+	if (Scheduler != LifoScheduler) {
+		SealLastGroup(NULL);
+	}
+
+	CurrBranchID++;
+
+	for (Slot = 0; Slot < SlotCount; Slot++) {
+		if (SetIsEmpty(EffectSets + Slot * SetWords) == true) {
+			continue;
+		}
+		Filled++;
+
+		if (IsHopeless(EffectSets + Slot * SetWords, Moves, *AreMovesOver) == false) {
+			if (TraceReplay == true) {
+				SlotsPushed[AddedTrans] = Slot;
+			} else if (TraceFile != NULL) {
+				Trace.TraceState = States[SlotLowest[Slot]]->id;
+				Trace.TraceStates = (SlotStates[Slot] != UINT32_MAX) ? SlotStates[Slot] : SetCount(EffectSets + Slot * SetWords);
+				Trace.TraceImplied = (SetStates == 1 && Choices == 1);
+			}
+			StackPush(SlotWrite[Slot], SlotMove[Slot], EffectSets + Slot * SetWords, (TraceFile != NULL && TraceReplay == false) ? &Trace : NULL, NULL);
+			AddedTrans++;
+		}
+	}
+
+	if (AddedTrans <= 1) {
+		CurrBranchID--;
+	}
+	// A move pushing every slot is only counted, so that a run of them takes a single continued run record
+	if (TraceReplay == true && TraceMoved == true && (uint32_t) AddedTrans == Filled && TracePaged == false) {
+		TraceMoved = false;
+		TracePending++;
+	} else if (TraceReplay == true) {
+		TraceReplayPushes(SlotsPushed, (uint32_t) AddedTrans, (uint32_t) AddedTrans == Filled, SkipLoops);
+	}
+	return false;
+}
+
+// Pushes transitions of a single state, as PushTransitions
+bool PushState(uint32_t StateIndex, char Read, int * AreMovesOver, bool SkipLoops) {
+	memset(SingleSet, 0, sizeof(uint64_t) * SetWords);
+	SingleSet[StateIndex / 64] |= 1ULL << (StateIndex % 64);
+
+	return PushTransitions(SingleSet, Read, AreMovesOver, SkipLoops);
+}
+
+// Adds every state of [From] to [To]
+void SetUnion(uint64_t * To, const uint64_t * From) {
+	unsigned int w = 0;
+
+#ifdef __SSE2__
+	for (; w + 2 <= SetWords; w += 2) {
+		__m128i Union = _mm_or_si128(_mm_loadu_si128((const __m128i *) (To + w)), _mm_loadu_si128((const __m128i *) (From + w)));
+		_mm_storeu_si128((__m128i *) (To + w), Union);
+	}
+#endif
+	for (; w < SetWords; w++) {
+		To[w] |= From[w];
+	}
+}
+
+uint32_t SetCount(const uint64_t * Set) {
+	uint32_t Count = 0;
+	unsigned int w;
+
+	for (w = 0; w < SetWords; w++) {
+		Count += (uint32_t) __builtin_popcountll(Set[w]);
+	}
+	return Count;
+}
+
+bool SetIsEmpty(const uint64_t * Set) {
+	unsigned int w;
+
+	for (w = 0; w < SetWords; w++) {
+		if (Set[w] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Orders transitions by tape effect, then by destination state
+int CompareEffects(const void * a, const void * b) {
+	const PackedTransition * TransA = a;
+	const PackedTransition * TransB = b;
+
+	if (TransA->Write != TransB->Write) {
+		return TransA->Write < TransB->Write ? -1 : 1;
+	}
+	if (TransA->Move != TransB->Move) {
+		return TransA->Move < TransB->Move ? -1 : 1;
+	}
+	if (TransA->ToState != TransB->ToState) {
+		return TransA->ToState < TransB->ToState ? -1 : 1;
 	}
+	return 0;
+}
+
+// Restores every cell written by branches newer than [BranchID] to its previous symbol.
+// Branch ids never decrease along WriteLog, so their symbols are at its end.
+// BranchID = -1 if complete symbols
+void FlushMemorySymbols(int BranchID) {
+    while (WrittenCount > 0) {
+        Symbol * OldSymbol = &WriteLog[WrittenCount - 1];
+        Cell * MemCell = TapeCell(OldSymbol->Position);
+
+        if (MemCell->BranchID <= BranchID) {
+            break;
+        }
+
+        *TapeSymbol(OldSymbol->Position) = OldSymbol->Symbol;
+        MemCell->BranchID = OldSymbol->BranchID;
+        MemCell->Older = OldSymbol->Next;
+        WrittenCount--;
+    }
+}
+
+void FreeMemory() {
+    ResetTape();
+    LargeFree(MemoryTape.Left.Symbols);
+    LargeFree(MemoryTape.Left.Cells);
+    LargeFree(MemoryTape.Right.Symbols);
+    LargeFree(MemoryTape.Right.Cells);
+    LargeFree(WriteLog);
+}
+
+void FreeStack() {
+    StackElem * StackTmp;
+
+    DiscardSpilled();
+    LastGroupCount = 0;
+
+    while ((StackTmp = StackPop()) != NULL) {
+        ReleaseSnapshot(StackTmp->Snap);
+        free(StackTmp);
+    }
+}
+
+// Moves the older half of the stack to spill file, in batches of SPILLBATCH elements
+void SpillFrontier() {
+    StackElem * Newest = Stack;
+    StackElem ** Detached;
+    size_t Kept = FrontierCount / 2, DetachedCount = 0, i, j;
+
+    if (Kept == 0) {
+        return;
+    }
+
+    if (SpillFile == NULL) {
+        SpillFile = tmpfile();
+        if (SpillFile == NULL) {
+            fprintf(stderr, "WARNING: Cannot create spill file, frontier budget disabled\n");
+            FrontierBudget = 0;
+            return;
+        }
+    }
+
+    for (i = 1; i < Kept; i++) {
+        Newest = Newest->Next;
+    }
+
+    Detached = malloc(sizeof(StackElem *) * (FrontierCount - Kept));
+    for (StackElem * Elem = Newest->Next; Elem != NULL; Elem = Elem->Next) {
+        Detached[DetachedCount++] = Elem;
+    }
+    Newest->Next = NULL;
+
+    // Oldest elements go in the first batches, so that batches are paged in in stack order
+    for (i = DetachedCount; i > 0; i = j) {
+        uint64_t BatchCount;
+
+        j = (i > SPILLBATCH) ? i - SPILLBATCH : 0;
+        BatchCount = i - j;
+
+        if (SpillBatchCount == SpillBatchCapacity) {
+            SpillBatchCapacity = (SpillBatchCapacity == 0) ? 16 : SpillBatchCapacity * 2;
+            SpillBatches = realloc(SpillBatches, sizeof(off_t) * SpillBatchCapacity);
+        }
+        if (fseeko(SpillFile, 0, SEEK_END) != 0 || (SpillBatches[SpillBatchCount++] = ftello(SpillFile)) < 0) {
+            SpillFailed("write");
+        }
+        SpillWrite(&BatchCount, sizeof(BatchCount), 1);
+
+        for (size_t k = i; k > j; k--) {
+            WriteSpilledElem(Detached[k - 1], (k < i) ? Detached[k] : NULL);
+        }
+    }
+
+    // Detached elements are only freed once they are all on disk
+    if (fflush(SpillFile) != 0 || ferror(SpillFile) != 0) {
+        SpillFailed("write");
+    }
+    for (i = 0; i < DetachedCount; i++) {
+        FrontierBytes -= Detached[i]->FrontierCharge;
+        ReleaseSnapshot(Detached[i]->Snap);
+        free(Detached[i]);
+    }
+    FrontierCount = Kept;
+    free(Detached);
+}
+
+// Writes [Elem] in spill file. Its tape isn't written again if it's the same of [Previous]
+void WriteSpilledElem(const StackElem * Elem, const StackElem * Previous) {
+    uint64_t MovesBuffer = Elem->MovesBuffer;
+    uint64_t SameTape = (Previous != NULL && ((Elem->Snap != NULL && Elem->Snap == Previous->Snap) ||
+        (Elem->Snap == NULL && Previous->Snap == NULL && Elem->BranchID == Previous->BranchID &&
+         Elem->MemPositionBuffer == Previous->MemPositionBuffer)));
+
+    SpillWrite(&Elem->Write, sizeof(Elem->Write), 1);
+    SpillWrite(&Elem->Move, sizeof(Elem->Move), 1);
+    SpillWrite(Elem->Targets, sizeof(uint64_t), SetWords);
+    SpillWrite(&MovesBuffer, sizeof(MovesBuffer), 1);
+    SpillWrite(&Elem->TraceParent, sizeof(Elem->TraceParent), 1);
+    SpillWrite(&SameTape, sizeof(SameTape), 1);
+
+    if (SameTape == 0) {
+        Snapshot * Snap = (Elem->Snap != NULL) ? Elem->Snap : CaptureSnapshot(Elem->BranchID - 1, MemoryTape.Min, MemoryTape.Max, Elem->MemPositionBuffer);
+
+        SpillWrite(&Snap->RunCount, sizeof(Snap->RunCount), 1);
+        SpillWrite(&Snap->Start, sizeof(Snap->Start), 1);
+        SpillWrite(&Snap->Head, sizeof(Snap->Head), 1);
+        SpillWrite(Snap->Symbols, 1, Snap->RunCount);
+        SpillWrite(Snap->Quantities, sizeof(uint64_t), Snap->RunCount);
+
+        if (Elem->Snap == NULL) {
+            ReleaseSnapshot(Snap);
+        }
+    }
+}
+
+// Reads the last spilled batch back on stack. Exits if the batch can't be read whole, as the branches left
+// out would turn an accepted tape into a rejected one
+void PageInFrontier() {
+    uint64_t BatchCount, i;
+    Snapshot * Snap = NULL;
+    off_t Offset = SpillBatches[--SpillBatchCount];
+
+    if (fflush(SpillFile) != 0 || ferror(SpillFile) != 0) {
+        SpillFailed("write");
+    }
+    if (fseeko(SpillFile, Offset, SEEK_SET) != 0) {
+        SpillFailed("read");
+    }
+    SpillRead(&BatchCount, sizeof(BatchCount), 1);
+
+    for (i = 0; i < BatchCount; i++) {
+        StackElem * NewElem = malloc(sizeof(StackElem) + sizeof(uint64_t) * SetWords);
+        uint64_t MovesBuffer, SameTape;
+
+        SpillRead(&NewElem->Write, sizeof(NewElem->Write), 1);
+        SpillRead(&NewElem->Move, sizeof(NewElem->Move), 1);
+        SpillRead(NewElem->Targets, sizeof(uint64_t), SetWords);
+        SpillRead(&MovesBuffer, sizeof(MovesBuffer), 1);
+        SpillRead(&NewElem->TraceParent, sizeof(NewElem->TraceParent), 1);
+        SpillRead(&SameTape, sizeof(SameTape), 1);
+
+        if (SameTape == 0) {
+            Snap = malloc(sizeof(Snapshot));
+            Snap->RefCount = 0;
+            Snap->Parent = NULL;
+            Snap->Depth = 0;
+            SpillRead(&Snap->RunCount, sizeof(Snap->RunCount), 1);
+            SpillRead(&Snap->Start, sizeof(Snap->Start), 1);
+            SpillRead(&Snap->Head, sizeof(Snap->Head), 1);
+            Snap->Symbols = malloc(Snap->RunCount);
+            Snap->Quantities = malloc(sizeof(uint64_t) * Snap->RunCount);
+            SpillRead(Snap->Symbols, 1, Snap->RunCount);
+            SpillRead(Snap->Quantities, sizeof(uint64_t), Snap->RunCount);
+        } else if (Snap == NULL) {
+            SpillFailed("read");
+        }
+
+        Snap->RefCount++;
+        NewElem->MovesBuffer = MovesBuffer;
+        NewElem->Snap = Snap;
+        NewElem->BranchID = 0;
+        NewElem->MemPositionBuffer = 0;
+        NewElem->Next = Stack;
+        Stack = NewElem;
+
+        FrontierCount++;
+        NewElem->FrontierCharge = StackElemBytes(NewElem);
+        FrontierBytes += NewElem->FrontierCharge;
+    }
+
+    fflush(SpillFile);
+    if (ftruncate(fileno(SpillFile), Offset) != 0) {
+        fprintf(stderr, "WARNING: Cannot truncate spill file\n");
+    }
+}
+
+// Reads window [From, To] of tape as seen by branches pushed after symbol version [Version]: for every cell,
+// its newest symbol written up to that version
+Snapshot * CaptureSnapshot(int Version, long From, long To, long Head) {
+    Snapshot * Snap = malloc(sizeof(Snapshot));
+    size_t Capacity = 16;
+    long p;
+
+    Snap->RefCount = 1;
+    Snap->RunCount = 0;
+    Snap->Start = From;
+    Snap->Head = Head;
+    Snap->Symbols = malloc(Capacity);
+    Snap->Quantities = malloc(sizeof(uint64_t) * Capacity);
+    Snap->Parent = NULL;
+    Snap->Depth = 0;
+
+    for (p = From; p <= To; p++) {
+        Cell * MemCell = TapeCell(p);
+        char Visible = *TapeSymbol(p);
+
+        if (MemCell->BranchID > Version) {
+            long Older = MemCell->Older;
+
+            while (Older >= 0 && WriteLog[Older].BranchID > Version) {
+                Older = WriteLog[Older].Next;
+            }
+            Visible = (Older >= 0) ? WriteLog[Older].Symbol : '_';
+        }
+
+        if (Snap->RunCount > 0 && Snap->Symbols[Snap->RunCount - 1] == Visible) {
+            Snap->Quantities[Snap->RunCount - 1]++;
+        } else {
+            if (Snap->RunCount == Capacity) {
+                Capacity *= 2;
+                Snap->Symbols = realloc(Snap->Symbols, Capacity);
+                Snap->Quantities = realloc(Snap->Quantities, sizeof(uint64_t) * Capacity);
+            }
+            Snap->Symbols[Snap->RunCount] = Visible;
+            Snap->Quantities[Snap->RunCount] = 1;
+            Snap->RunCount++;
+        }
+    }
+
+    return Snap;
+}
+
+// Writes [Snap] on empty memory tape, as symbols of branch 0, and moves head where it was
+void LoadSnapshot(const Snapshot * Snap) {
+    long p = Snap->Start;
+    uint64_t r, q;
+
+    if (Snap->Parent != NULL) {
+        LoadSnapshot(Snap->Parent);
+    }
+
+    TapeReserve(p);
+    for (r = 0; r < Snap->RunCount; r++) {
+        TapeReserve(p + (long) Snap->Quantities[r] - 1);
+
+        for (q = 0; q < Snap->Quantities[r]; q++, p++) {
+            char * MemSymbol = TapeSymbol(p);
+            if (Visited != NULL) {
+                TapeHashCell(p, *MemSymbol, Snap->Symbols[r]);
+            }
+            *MemSymbol = Snap->Symbols[r];
+        }
+    }
+
+    TapeReserve(Snap->Head);
+    CurrMemPosition = Snap->Head;
+}
+
+void ReleaseSnapshot(Snapshot * Snap) {
+    while (Snap != NULL && --Snap->RefCount == 0) {
+        Snapshot * Parent = Snap->Parent;
+
+        free(Snap->Symbols);
+        free(Snap->Quantities);
+        free(Snap);
+        Snap = Parent;
+    }
+}
+
+// Memory used by [Snap], split among elements sharing it
+size_t SnapshotBytes(const Snapshot * Snap) {
+    if (Snap == NULL) {
+        return 0;
+    }
+    return (sizeof(Snapshot) + Snap->RunCount * (1 + sizeof(uint64_t))) / (size_t) (Snap->RefCount > 0 ? Snap->RefCount : 1);
+}
+
+// Drops every spilled batch. Errors of their writes don't matter anymore
+void DiscardSpilled() {
+    if (SpillBatchCount > 0) {
+        SpillBatchCount = 0;
+        fflush(SpillFile);
+        if (ftruncate(fileno(SpillFile), 0) != 0) {
+            fprintf(stderr, "WARNING: Cannot truncate spill file\n");
+        }
+        rewind(SpillFile);
+        clearerr(SpillFile);
+    }
+}
+
+// Writes [Count] items of [Size] bytes from [Data] in spill file
+void SpillWrite(const void * Data, size_t Size, size_t Count) {
+    if (fwrite(Data, Size, Count, SpillFile) != Count) {
+        SpillFailed("write");
+    }
+}
+
+// Reads [Count] items of [Size] bytes from spill file in [Data]
+void SpillRead(void * Data, size_t Size, size_t Count) {
+    if (fread(Data, Size, Count, SpillFile) != Count) {
+        SpillFailed("read");
+    }
+}
+
+// Exits on a failed spill file [Action]: going on without the spilled branches could give a wrong result
+void SpillFailed(const char * Action) {
+    fprintf(stderr, "ERROR: Cannot %s spill file\n", Action);
+    exit(1);
+}
+
+// Parses a size in bytes, with optional K, M or G suffix
+size_t ParseSize(const char * Size) {
+    char * Suffix;
+    size_t Bytes = strtoul(Size, &Suffix, 10);
+
+    if (*Suffix == 'K' || *Suffix == 'k') {
+        Bytes <<= 10;
+    } else if (*Suffix == 'M' || *Suffix == 'm') {
+        Bytes <<= 20;
+    } else if (*Suffix == 'G' || *Suffix == 'g') {
+        Bytes <<= 30;
+    }
+
+    return Bytes;
+}
+
+void FreeTM() {
+    FreeTransitions(TM->root);
+    FreeNodes(TM->root);
+
+    free(TM->nil);
+    free(TM);
+}
+
+void FreeTransitions(TreeNode * x) {
+    // For every tree node (state)
+    if (x != TM->nil) {
+        // Free left tree
+        FreeTransitions(x->left);
+
+        TransitionList * Character = x->StatePtr->CharacterList;
+        // For every Character struct. in character list
+        while (Character != NULL) {
+            Transition * Transitions = Character->Transitions;
+
+            // For every transition in list
+            while (Transitions != NULL) {
+                Transition * TempTrans = Transitions;
+                Transitions = Transitions->NextTransition;
+                // Free transition and repeat with next
+                free(TempTrans);
+            }
+
+            // Transition list is now NULL
+            Character->Transitions = NULL;
+
+            TransitionList * Temp = Character;
+            Character = Character->Next;
+            // Free Character and repeat with next in list
+            free(Temp);
+        }
+
+        // Character list is now NULL
+        x->StatePtr->CharacterList = NULL;
+
+        // Free right tree
+        FreeTransitions(x->right);
+    }
+}
+
+void FreeNodes(TreeNode * x) {
+    // For every tree node (state)
+    if (x != TM->nil) {
+        // Create temporary right tree ptr
+        TreeNode * RightTree = x->right;
+
+        // Free left tree
+        FreeNodes(x->left);
+
+        // Free this node
+        free(x->StatePtr);
+        free(x);
+
+        // Free right tree through temp ptr
+        FreeNodes(RightTree);
+    }
+}
+// Orders transitions by (Read, Write, HeadMoveDirection, ToState)
+int CompareTransitions(const void * a, const void * b) {
+    const Transition * x = *(const Transition **) a;
+    const Transition * y = *(const Transition **) b;
+
+    if (x->Read != y->Read) {
+        return (unsigned char) x->Read - (unsigned char) y->Read;
+    }
+    if (x->Write != y->Write) {
+        return (unsigned char) x->Write - (unsigned char) y->Write;
+    }
+    if (x->HeadMoveDirection != y->HeadMoveDirection) {
+        return (unsigned char) x->HeadMoveDirection - (unsigned char) y->HeadMoveDirection;
+    }
+    if (x->ToState->id != y->ToState->id) {
+        return (x->ToState->id < y->ToState->id) ? -1 : 1;
+    }
+    return 0;
+}
+
+// Hashes every state (in id order) with its sorted transitions
+void HashMachineStates(TreeNode * x, uint64_t * Hash) {
+    if (x != TM->nil) {
+        HashMachineStates(x->left, Hash);
+
+        State * CurrState = x->StatePtr;
+        size_t TransCount = 0, i;
+        TransitionList * CharElem;
+        Transition * TransElem;
+
+        for (CharElem = CurrState->CharacterList; CharElem != NULL; CharElem = CharElem->Next) {
+            for (TransElem = CharElem->Transitions; TransElem != NULL; TransElem = TransElem->NextTransition) {
+                TransCount++;
+            }
+        }
+
+        Transition ** Sorted = malloc(sizeof(Transition *) * (TransCount + 1));
+        TransCount = 0;
+        for (CharElem = CurrState->CharacterList; CharElem != NULL; CharElem = CharElem->Next) {
+            for (TransElem = CharElem->Transitions; TransElem != NULL; TransElem = TransElem->NextTransition) {
+                Sorted[TransCount++] = TransElem;
+            }
+        }
+        qsort(Sorted, TransCount, sizeof(Transition *), CompareTransitions);
+
+        *Hash = HashBytes(*Hash, &CurrState->id, sizeof(CurrState->id));
+        *Hash = HashBytes(*Hash, &CurrState->IsAcceptanceState, sizeof(CurrState->IsAcceptanceState));
+        for (i = 0; i < TransCount; i++) {
+            *Hash = HashBytes(*Hash, &Sorted[i]->Read, 1);
+            *Hash = HashBytes(*Hash, &Sorted[i]->Write, 1);
+            *Hash = HashBytes(*Hash, &Sorted[i]->HeadMoveDirection, 1);
+            *Hash = HashBytes(*Hash, &Sorted[i]->ToState->id, sizeof(Sorted[i]->ToState->id));
+        }
+
+        free(Sorted);
+
+        HashMachineStates(x->right, Hash);
+    }
+}
+
+// Computes a fingerprint of the machine that doesn't depend on the order of tr lines
+void ComputeMachineFingerprint() {
+    size_t i;
+
+    MachineFingerprint = FNVOFFSET;
+    HashMachineStates(TM->root, &MachineFingerprint);
+
+    // Expanded transitions only match the input symbols seen so far, the rest of the machine is in its wildcards
+    for (i = 0; TrackCount > 1 && i < TrackTransitionCount; i++) {
+        MachineFingerprint = HashBytes(MachineFingerprint, &TrackTransitions[i].Start, sizeof(TrackTransitions[i].Start));
+        MachineFingerprint = HashBytes(MachineFingerprint, &TrackTransitions[i].End, sizeof(TrackTransitions[i].End));
+        MachineFingerprint = HashBytes(MachineFingerprint, TrackTransitions[i].Read, TrackCount);
+        MachineFingerprint = HashBytes(MachineFingerprint, TrackTransitions[i].Write, TrackCount);
+        MachineFingerprint = HashBytes(MachineFingerprint, &TrackTransitions[i].MemDirection, 1);
+    }
+}
+
+// FNV-1a hash of [Data], starting from [Hash]
+uint64_t HashBytes(uint64_t Hash, const void * Data, size_t Size) {
+    const unsigned char * Bytes = Data;
+    size_t i;
+
+    for (i = 0; i < Size; i++) {
+        Hash ^= Bytes[i];
+        Hash *= FNVPRIME;
+    }
+
+    return Hash;
+}
+
+// Hash of [Data] with Mix64 on 8 bytes at a time, unrelated to HashBytes: cache keys hold both, so that
+// a single hash collision can't give the result of another tape
+uint64_t HashWords(const void * Data, size_t Size) {
+    const unsigned char * Bytes = Data;
+    uint64_t Hash = Mix64(Size ^ ZOBRISTSEEDB), Word;
+    size_t i;
+
+    for (i = 0; i + sizeof(Word) <= Size; i += sizeof(Word)) {
+        memcpy(&Word, Bytes + i, sizeof(Word));
+        Hash = Mix64(Hash ^ Word) + ZOBRISTSEEDA;
+    }
+    Word = 0;
+    memcpy(&Word, Bytes + i, Size - i);
+
+    return Mix64(Hash ^ Word);
+}
+
+ResultCache * CacheCreate(size_t Capacity, const char * DiskPath) {
+    ResultCache * C = malloc(sizeof(ResultCache));
+
+    C->Capacity = Capacity;
+    C->Size = 0;
+    C->BucketCount = 1;
+    while (C->BucketCount < Capacity) {
+        C->BucketCount <<= 1;
+    }
+    C->Buckets = calloc(C->BucketCount, sizeof(CacheEntry *));
+    C->MostRecent = NULL;
+    C->LeastRecent = NULL;
+
+    C->DiskFile = -1;
+    C->DiskRecords = NULL;
+    C->DiskRecordCount = 0;
+    C->DiskIndex = NULL;
+    C->DiskIndexSize = 0;
+
+    if (DiskPath != NULL) {
+        CacheLoadDisk(C, DiskPath);
+    }
+
+    return C;
+}
+
+// Maps records of cache file and indexes them. New records are appended to the same file. The first record
+// only marks the file format: files without it are from older versions, whose keys lack TapeCheck, and are
+// left alone
+void CacheLoadDisk(ResultCache * C, const char * DiskPath) {
+    struct stat FileStat;
+    CacheRecord Header;
+    size_t i, j;
+
+    C->DiskFile = open(DiskPath, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (C->DiskFile < 0) {
+        fprintf(stderr, "WARNING: Cannot open cache file %s\n", DiskPath);
+        return;
+    }
+
+    if (fstat(C->DiskFile, &FileStat) != 0) {
+        return;
+    }
+    if (FileStat.st_size == 0) {
+        memset(&Header, 0, sizeof(Header));
+        Header.Fingerprint = CACHEMAGIC;
+        if (write(C->DiskFile, &Header, sizeof(Header)) != sizeof(Header)) {
+            fprintf(stderr, "WARNING: Cannot append to cache file\n");
+            close(C->DiskFile);
+            C->DiskFile = -1;
+        }
+        return;
+    }
+    if (FileStat.st_size < (off_t) sizeof(CacheRecord) || pread(C->DiskFile, &Header, sizeof(Header), 0) != sizeof(Header) ||
+        Header.Fingerprint != CACHEMAGIC) {
+        fprintf(stderr, "WARNING: Cache file %s has another format, it is not used\n", DiskPath);
+        close(C->DiskFile);
+        C->DiskFile = -1;
+        return;
+    }
+
+    // Partially written records at the end of file are ignored
+    C->DiskRecordCount = (size_t) FileStat.st_size / sizeof(CacheRecord);
+    C->DiskRecords = mmap(NULL, C->DiskRecordCount * sizeof(CacheRecord), PROT_READ, MAP_PRIVATE, C->DiskFile, 0);
+    if (C->DiskRecords == MAP_FAILED) {
+        C->DiskRecords = NULL;
+        C->DiskRecordCount = 0;
+        return;
+    }
+
+    C->DiskIndexSize = 1;
+    while (C->DiskIndexSize < C->DiskRecordCount * 2) {
+        C->DiskIndexSize <<= 1;
+    }
+    C->DiskIndex = calloc(C->DiskIndexSize, sizeof(size_t));
+
+    for (i = 1; i < C->DiskRecordCount; i++) {
+        j = (C->DiskRecords[i].TapeHash ^ C->DiskRecords[i].Fingerprint) & (C->DiskIndexSize - 1);
+        while (C->DiskIndex[j] != 0) {
+            j = (j + 1) & (C->DiskIndexSize - 1);
+        }
+        C->DiskIndex[j] = i + 1;
+    }
+}
+
+size_t CacheBucket(const ResultCache * C, const CacheRecord * Key) {
+    uint64_t Hash = Key->TapeHash ^ Key->Fingerprint ^ (Key->MaxMoves * FNVPRIME);
+    return (size_t) (Hash ^ (Hash >> 32)) & (C->BucketCount - 1);
+}
+
+bool CacheKeyEquals(const CacheRecord * a, const CacheRecord * b) {
+    return a->Fingerprint == b->Fingerprint && a->TapeHash == b->TapeHash && a->TapeCheck == b->TapeCheck &&
+           a->MaxMoves == b->MaxMoves && a->TapeLength == b->TapeLength;
+}
+
+// Searches [Key] in cache and sets its Result. Returns false if [Key] is not cached
+bool CacheLookup(ResultCache * C, CacheRecord * Key) {
+    CacheEntry * Entry = C->Buckets[CacheBucket(C, Key)];
+
+    while (Entry != NULL && CacheKeyEquals(&Entry->Record, Key) == false) {
+        Entry = Entry->HashNext;
+    }
+
+    if (Entry != NULL) {
+        // Move entry to the head of LRU list
+        if (Entry != C->MostRecent) {
+            Entry->Newer->Older = Entry->Older;
+            if (Entry->Older != NULL) {
+                Entry->Older->Newer = Entry->Newer;
+            } else {
+                C->LeastRecent = Entry->Newer;
+            }
+            Entry->Newer = NULL;
+            Entry->Older = C->MostRecent;
+            C->MostRecent->Newer = Entry;
+            C->MostRecent = Entry;
+        }
+
+        Key->Result = Entry->Record.Result;
+        return true;
+    }
+
+    if (C->DiskIndex != NULL) {
+        size_t j = (Key->TapeHash ^ Key->Fingerprint) & (C->DiskIndexSize - 1);
+
+        while (C->DiskIndex[j] != 0) {
+            if (CacheKeyEquals(&C->DiskRecords[C->DiskIndex[j] - 1], Key)) {
+                Key->Result = C->DiskRecords[C->DiskIndex[j] - 1].Result;
+                CacheInsert(C, Key);
+                return true;
+            }
+            j = (j + 1) & (C->DiskIndexSize - 1);
+        }
+    }
+
+    return false;
+}
+
+// Adds [Record] to the in-memory LRU, evicting least recently used entry if full
+void CacheInsert(ResultCache * C, const CacheRecord * Record) {
+    CacheEntry * Entry;
+    CacheEntry ** BucketElem;
+
+    if (C->Capacity == 0) {
+        return;
+    }
+
+    if (C->Size == C->Capacity) {
+        Entry = C->LeastRecent;
+        C->LeastRecent = Entry->Newer;
+        if (C->LeastRecent != NULL) {
+            C->LeastRecent->Older = NULL;
+        } else {
+            C->MostRecent = NULL;
+        }
+
+        BucketElem = &C->Buckets[CacheBucket(C, &Entry->Record)];
+        while (*BucketElem != Entry) {
+            BucketElem = &(*BucketElem)->HashNext;
+        }
+        *BucketElem = Entry->HashNext;
+    } else {
+        Entry = malloc(sizeof(CacheEntry));
+        C->Size++;
+    }
+
+    Entry->Record = *Record;
+    BucketElem = &C->Buckets[CacheBucket(C, Record)];
+    Entry->HashNext = *BucketElem;
+    *BucketElem = Entry;
+
+    Entry->Newer = NULL;
+    Entry->Older = C->MostRecent;
+    if (C->MostRecent != NULL) {
+        C->MostRecent->Newer = Entry;
+    } else {
+        C->LeastRecent = Entry;
+    }
+    C->MostRecent = Entry;
+}
+
+// Caches a new simulation result, both in memory and on disk
+void CacheStore(ResultCache * C, const CacheRecord * Record) {
+    CacheInsert(C, Record);
+
+    if (C->DiskFile >= 0 && write(C->DiskFile, Record, sizeof(CacheRecord)) != sizeof(CacheRecord)) {
+        fprintf(stderr, "WARNING: Cannot append to cache file\n");
+        close(C->DiskFile);
+        C->DiskFile = -1;
+    }
+}
 
-	MemCellTmp = MemCell;
+void CacheFree(ResultCache * C) {
+    if (C == NULL) {
+        return;
+    }
 
-	while (MemCellTmp->Left != NULL) {
-		MemCellTmp = MemCellTmp->Left;
-		MemCellTmp->Symbols->CurrSymbol = MemCellTmp->Symbols->SymbolQty;
-	}
+    while (C->MostRecent != NULL) {
+        CacheEntry * EntryTmp = C->MostRecent;
+        C->MostRecent = C->MostRecent->Older;
+        free(EntryTmp);
+    }
+    free(C->Buckets);
 
+    if (C->DiskRecords != NULL) {
+        munmap(C->DiskRecords, C->DiskRecordCount * sizeof(CacheRecord));
+    }
+    if (C->DiskFile >= 0) {
+        close(C->DiskFile);
+    }
+    free(C->DiskIndex);
+    free(C);
 }
 
-void FreeStack() {
-    StackElem * StackTmp = Stack;
+// Writes trace file header and machine transitions, once machine is packed
+void TraceWriteHeader() {
+    TraceHeader Header;
 
-    while (StackTmp != NULL) {
-        StackTmp = StackPop();
-        free(StackTmp);
+    Header.Magic = TRACEMAGIC;
+    Header.Version = TRACEVERSION;
+    Header.Fingerprint = MachineFingerprint;
+    Header.TransitionCount = PackedTransitionCount();
+    Header.Flags = (Scheduler == LifoScheduler) ? TRACEREPLAYED : 0;
+    TraceReplay = (Scheduler == LifoScheduler);
+    fwrite(&Header, sizeof(Header), 1, TraceFile);
+
+    TraceWriteTransitions();
+}
+
+// Writes every packed transition as a TraceTransition
+void TraceWriteTransitions() {
+    TraceTransition Record;
+    uint32_t s, k, t;
+
+    Record.Reserved = 0;
+    for (s = 0; s < StateCount; s++) {
+        for (k = 0; k < States[s]->KeyCount; k++) {
+            for (t = States[s]->FirstTransition[k]; t < States[s]->FirstTransition[k + 1]; t++) {
+                Record.From = States[s]->id;
+                Record.To = States[Packed[t].ToState]->id;
+                Record.Read = States[s]->Keys[k];
+                Record.Write = Packed[t].Write;
+                Record.Move = Packed[t].Move;
+                fwrite(&Record, sizeof(Record), 1, TraceFile);
+            }
+        }
     }
 }
 
-void FreeTM() {
-    FreeTransitions(TM->root);
-    FreeNodes(TM->root);
+// Adds the record of a tape with its symbols, before its moves. If the machine was packed again, its transitions follow
+void TraceTapeStart(const char * Input, size_t Length) {
+    TraceContinued();
+    if (TraceRingCount + TRACEMAXRECORD > TRACEBUFFER) {
+        TraceFlush();
+    }
+    TracePutNumber((TraceMachineChanged == true) ? TraceTape | TRACEMACHINE : TraceTape);
+    TracePutNumber(TraceTapeCount++);
+    TracePutNumber(Length);
+    TraceFlush();
+    fwrite(Input, 1, Length, TraceFile);
+
+    if (TraceMachineChanged == true) {
+        TracePutNumber(PackedTransitionCount());
+        TraceFlush();
+        TraceWriteTransitions();
+        TraceMachineChanged = false;
+    }
 
-    free(TM->nil);
-    free(TM);
+    TraceTapeRecord = TraceRecordCount++;
+    TraceLast = TRACENOPARENT;
+    TraceBranch = 0;
+    TraceMoved = false;
+    TracePaged = false;
 }
 
-void FreeTransitions(TreeNode * x) {
-    // For every tree node (state)
-    if (x != TM->nil) {
-        // Free left tree
-        FreeTransitions(x->left);
+// Adds a run record for the moves of the deterministic engine since tape start, if it made any
+void TraceDeterministicRun() {
+    uint64_t Count = MaxMoves - DetMovesLeft;
 
-        TransitionList * Character = x->StatePtr->CharacterList;
-        // For every Character struct. in character list
-        while (Character != NULL) {
-            Transition * Transitions = Character->Transitions;
+    TraceContinued();
+    if (Count > 0) {
+        if (TraceRingCount + TRACEMAXRECORD > TRACEBUFFER) {
+            TraceFlush();
+        }
+        TracePutNumber(TraceRun);
+        TracePutNumber(Count);
 
-            // For every transition in list
-            while (Transitions != NULL) {
-                Transition * TempTrans = Transitions;
-                Transitions = Transitions->NextTransition;
-                // Free transition and repeat with next
-                free(TempTrans);
+        TraceRecordCount += Count;
+        TraceLast = TraceRecordCount - 1;
+    }
+    DetMovesLeft = MaxMoves;
+}
+
+// Adds a step or a result record to trace. Returns its record nr.
+uint64_t TraceAppend(uint8_t Kind, char Read, char Write, unsigned char Move, uint32_t StateId, uint32_t StateCount, uint64_t Parent) {
+    uint32_t Tag = Kind;
+
+    TraceContinued();
+    if (TraceRingCount + TRACEMAXRECORD > TRACEBUFFER) {
+        TraceFlush();
+    }
+
+    // A move with no parent is never the child of the record before (a tape or a result record)
+    if (Parent != TraceRecordCount - 1) {
+        Tag |= TRACEPARENT;
+    }
+    if (Kind == TraceStep) {
+        Tag |= (uint32_t) Move << TRACEMOVESHIFT;
+        Tag |= (StateCount != 1) ? TRACESTATES : 0;
+        Tag |= (CurrBranchID != TraceBranch) ? TRACEBRANCH : 0;
+    }
+
+    TracePutNumber(Tag);
+    if (Kind == TraceStep) {
+        TraceRing[TraceRingCount++] = (unsigned char) Read;
+        TraceRing[TraceRingCount++] = (unsigned char) Write;
+    }
+    TracePutNumber(StateId);
+
+    if ((Tag & TRACEPARENT) != 0) {
+        TracePutNumber((Parent == TRACENOPARENT) ? 0 : TraceRecordCount - Parent);
+    }
+    if ((Tag & TRACESTATES) != 0) {
+        TracePutNumber(StateCount);
+    }
+    if ((Tag & TRACEBRANCH) != 0) {
+        TracePutNumber(((uint64_t) (int64_t) CurrBranchID << 1) ^ (uint64_t) ((int64_t) CurrBranchID >> 63));
+        TraceBranch = CurrBranchID;
+    }
+    if (Kind == TraceResult) {
+        TracePutNumber(TraceRecordCount - TraceTapeRecord - 1);
+    }
+
+    return TraceRecordCount++;
+}
+
+// Adds the move of branch [Elem] of branching engine to trace. A move the trace can replay, as it's the only one
+// of the move before, is only counted, so that a run of them takes a single continued run record
+uint64_t TraceMove(char Read, const StackElem * Elem) {
+    if (Elem->TraceImplied == true && Elem->TraceParent == TraceRecordCount - 1 && CurrBranchID == TraceBranch) {
+        TracePending++;
+        return TraceRecordCount++;
+    }
+
+    return TraceAppend(TraceStep, Read, Elem->Write, Elem->Move, Elem->TraceState, Elem->TraceStates, Elem->TraceParent);
+}
+
+// Adds the replayed step of the pushes of the last move of branching engine, or of the first state if it didn't
+// move yet: [Count] [Slots], that are every slot with a state if [All]
+void TraceReplayPushes(const uint32_t * Slots, uint32_t Count, bool All, bool SkipLoops) {
+    uint32_t Tag = TraceStep | TRACEREPLAY, i;
+
+    TraceContinued();
+    if (TraceRingCount + TRACEMAXRECORD + 2 * Count > TRACEBUFFER) {
+        TraceFlush();
+    }
+
+    if (TraceMoved == false) {
+        Tag |= (SkipLoops == true) ? TRACEEXPAND | TRACERESUMED : TRACEEXPAND;
+    } else if (TracePaged == true) {
+        Tag |= TRACEPAGED;
+    }
+    Tag |= (All == false) ? TRACEPUSHED : 0;
+
+    TracePutNumber(Tag);
+    if (All == false) {
+        TracePutNumber(Count);
+        for (i = 0; i < Count; i++) {
+            TracePutNumber(Slots[i]);
+        }
+    }
+
+    TraceMoved = false;
+    TracePaged = false;
+}
+
+// Adds the replayed step of a branch dropped by branching engine
+void TraceDropped() {
+    TraceContinued();
+    if (TraceRingCount + TRACEMAXRECORD > TRACEBUFFER) {
+        TraceFlush();
+    }
+    TracePutNumber(TraceStep | TRACEREPLAY | TRACEDROPPED);
+}
+
+// Adds the continued run record of the moves only counted by TraceMove or PushTransitions, if any
+void TraceContinued() {
+    if (TracePending > 0) {
+        if (TraceRingCount + TRACEMAXRECORD > TRACEBUFFER) {
+            TraceFlush();
+        }
+        TracePutNumber(TraceRun | TRACECONTINUED);
+        TracePutNumber(TracePending);
+        TracePending = 0;
+    }
+}
+
+// Adds [Number] to trace as LEB128
+void TracePutNumber(uint64_t Number) {
+    while (Number >= 0x80) {
+        TraceRing[TraceRingCount++] = (unsigned char) (Number | 0x80);
+        Number >>= 7;
+    }
+    TraceRing[TraceRingCount++] = (unsigned char) Number;
+}
+
+void TraceFlush() {
+    fwrite(TraceRing, 1, TraceRingCount, TraceFile);
+    TraceRingCount = 0;
+}
+
+// Bijective 64 bit mixer (splitmix64 finalizer)
+uint64_t Mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Updates tape hashes for cell at [Position] going from [Old] to [New]. Blank cells don't count
+void TapeHashCell(long Position, char Old, char New) {
+    uint64_t Key = (uint64_t) Position << 8;
+
+    if (Old != '_') {
+        TapeHash[0] ^= Mix64((Key | (unsigned char) Old) ^ ZOBRISTSEEDA);
+        TapeHash[1] ^= Mix64((Key | (unsigned char) Old) + ZOBRISTSEEDB);
+    }
+    if (New != '_') {
+        TapeHash[0] ^= Mix64((Key | (unsigned char) New) ^ ZOBRISTSEEDA);
+        TapeHash[1] ^= Mix64((Key | (unsigned char) New) + ZOBRISTSEEDB);
+    }
+}
+
+// Looks up current configuration of branching engine (tape, head, moves left and states [Set]) in visited table,
+// adding it if missing. Returns true if it was already expanded: its branches give the same results
+bool VisitedSeen(const uint64_t * Set) {
+    uint64_t Lo = TapeHash[0], Hi = TapeHash[1];
+    unsigned int w;
+
+    Lo = Mix64(Lo ^ (uint64_t) CurrMemPosition);
+    Hi = Mix64(Hi + (uint64_t) CurrMemPosition * ZOBRISTSEEDA);
+    Lo = Mix64(Lo ^ Moves);
+    Hi = Mix64(Hi + Moves * ZOBRISTSEEDA);
+    for (w = 0; w < SetWords; w++) {
+        Lo = Mix64(Lo ^ Set[w]);
+        Hi = Mix64(Hi + Set[w] * ZOBRISTSEEDA);
+    }
+
+    return VisitedInsert(Visited, Lo, Hi, &VisitedCounters);
+}
+
+// Creates a visited table with [Capacity] slots at least, rounded up to a power of 2
+VisitedTable * VisitedCreate(size_t Capacity, VisitedPolicy Policy) {
+    VisitedTable * Table = malloc(sizeof(VisitedTable));
+    size_t Slots = VISITEDPROBES;
+
+    while (Slots < Capacity) {
+        Slots <<= 1;
+    }
+
+    // Slots are aligned to cache lines, so a probe window touches as few lines as possible
+    Table->Slots = aligned_alloc(64, sizeof(VisitedSlot) * Slots);
+    memset(Table->Slots, 0, sizeof(VisitedSlot) * Slots);
+    Table->Mask = Slots - 1;
+    Table->Epoch = 1;
+    Table->Policy = Policy;
+
+    return Table;
+}
+
+// Inserts fingerprint [Lo, Hi] in [Table]. Returns true if it was already there. Both words are compared but
+// 16 bits of Hi, so two configurations are only mistaken for each other if their 112 compared bits agree
+bool VisitedInsert(VisitedTable * Table, uint64_t Lo, uint64_t Hi, VisitedStats * Stats) {
+    uint64_t Tag = (Table->Epoch << VISITEDTAGBITS) | (Hi & ((1ULL << VISITEDTAGBITS) - 1));
+    uint64_t p;
+
+    Stats->Lookups++;
+
+    for (p = 0; p < VISITEDPROBES; p++) {
+        VisitedSlot * Slot = &Table->Slots[(Lo + p) & Table->Mask];
+
+        if (Slot->Tag == Tag && Slot->Lo == Lo) {
+            Stats->Hits++;
+            return true;
+        }
+        // Empty slot, or one left by an older tape
+        if (Slot->Tag >> VISITEDTAGBITS != Table->Epoch) {
+            Slot->Lo = Lo;
+            Slot->Tag = Tag;
+            Stats->Inserts++;
+            Stats->Probes += p;
+            return false;
+        }
+    }
+
+    Stats->Probes += VISITEDPROBES;
+    if (Table->Policy == ReplacePolicy) {
+        Table->Slots[Lo & Table->Mask] = (VisitedSlot) {Lo, Tag};
+        Stats->Evictions++;
+    } else {
+        Stats->Dropped++;
+    }
+
+    return false;
+}
+
+// Makes every configuration in [Table] stale. Slots are cleared only when epochs wrap around
+void VisitedNextTape(VisitedTable * Table) {
+    Table->Epoch++;
+    if (Table->Epoch >> (64 - VISITEDTAGBITS) != 0) {
+        memset(Table->Slots, 0, sizeof(VisitedSlot) * (Table->Mask + 1));
+        Table->Epoch = 1;
+    }
+}
+
+void VisitedReport(const VisitedTable * Table, const VisitedStats * Stats) {
+    uint64_t Used = 0, i;
+
+    // Occupancy of the last tape
+    for (i = 0; i <= Table->Mask; i++) {
+        Used += (Table->Slots[i].Tag != 0 && Table->Slots[i].Tag >> VISITEDTAGBITS == Table->Epoch - 1);
+    }
+
+    fprintf(stderr, "Visited table: %llu slots, %llu lookups, %llu hits, %llu inserts, %.2f probes per lookup, "
+            "%llu evictions, %llu dropped, last tape used %llu slots\n",
+            (unsigned long long) (Table->Mask + 1), (unsigned long long) Stats->Lookups, (unsigned long long) Stats->Hits,
+            (unsigned long long) Stats->Inserts, Stats->Lookups > 0 ? (double) Stats->Probes / (double) Stats->Lookups : 0.0,
+            (unsigned long long) Stats->Evictions, (unsigned long long) Stats->Dropped, (unsigned long long) Used);
+}
+
+void VisitedFree(VisitedTable * Table) {
+    if (Table != NULL) {
+        free(Table->Slots);
+        free(Table);
+    }
+}
+
+// Key of [Elem] for current scheduler
+long BranchKey(const StackElem * Elem) {
+    long Key = -__LONG_MAX__;
+    unsigned int w;
+
+    if (Scheduler == MovesScheduler) {
+        return -(long) Elem->MovesBuffer;
+    } else if (Scheduler == DistanceScheduler) {
+        return (long) SetGoalDistance(Elem->Targets);
+    }
+
+    for (w = 0; w < SetWords; w++) {
+        uint64_t Bits = Elem->Targets[w];
+
+        for (; Bits != 0; Bits &= Bits - 1) {
+            State * Target = States[w * 64 + (uint32_t) __builtin_ctzll(Bits)];
+
+            if (Target->Priority > Key) {
+                Key = Target->Priority;
             }
+        }
+    }
 
-            // Transition list is now NULL
-            Character->Transitions = NULL;
+    return -Key;
+}
 
-            TransitionList * Temp = Character;
-            Character = Character->Next;
-            // Free Character and repeat with next in list
-            free(Temp);
+bool HeapBefore(const HeapEntry * a, const HeapEntry * b) {
+    return a->Key < b->Key || (a->Key == b->Key && a->Sequence > b->Sequence);
+}
+
+void HeapPush(StackElem * Elem) {
+    HeapEntry Entry;
+    size_t i;
+
+    if (HeapCount == HeapCapacity) {
+        HeapCapacity = (HeapCapacity == 0) ? 256 : HeapCapacity * 2;
+        Heap = realloc(Heap, sizeof(HeapEntry) * HeapCapacity);
+    }
+
+    Entry.Key = BranchKey(Elem);
+    Entry.Sequence = HeapSequence++;
+    Entry.Elem = Elem;
+
+    // Sift up
+    for (i = HeapCount++; i > 0 && HeapBefore(&Entry, &Heap[(i - 1) / HEAPARITY]) == true; i = (i - 1) / HEAPARITY) {
+        Heap[i] = Heap[(i - 1) / HEAPARITY];
+    }
+    Heap[i] = Entry;
+}
+
+StackElem * HeapPop() {
+    StackElem * Elem;
+    HeapEntry Last;
+    size_t i = 0;
+
+    if (HeapCount == 0) {
+        return NULL;
+    }
+
+    Elem = Heap[0].Elem;
+    Last = Heap[--HeapCount];
+    SealLastGroup(Elem);
+
+    // Sift down the last entry from the root
+    while (true) {
+        size_t First = i * HEAPARITY + 1, Best = First, c;
+
+        if (First >= HeapCount) {
+            break;
+        }
+        for (c = First + 1; c < First + HEAPARITY && c < HeapCount; c++) {
+            if (HeapBefore(&Heap[c], &Heap[Best]) == true) {
+                Best = c;
+            }
+        }
+        if (HeapBefore(&Heap[Best], &Last) == false) {
+            break;
         }
+        Heap[i] = Heap[Best];
+        i = Best;
+    }
+    if (HeapCount > 0) {
+        Heap[i] = Last;
+    }
 
-        // Character list is now NULL
-        x->StatePtr->CharacterList = NULL;
+    return Elem;
+}
 
-        // Free right tree
-        FreeTransitions(x->right);
+// Branches popped out of stack order can't rebuild their tape from symbol versions: before the tape changes,
+// gives a shared snapshot of it to branches of the last push but [Except], that runs on current tape
+void SealLastGroup(const StackElem * Except) {
+    Snapshot * Snap = NULL;
+    size_t i;
+
+    for (i = 0; i < LastGroupCount; i++) {
+        StackElem * Elem = LastGroup[i];
+
+        if (Elem == Except) {
+            continue;
+        }
+        if (Snap == NULL) {
+            Snap = CaptureDelta(Elem->MemPositionBuffer);
+        }
+        Elem->Snap = Snap;
+        Snap->RefCount++;
     }
+
+    ReleaseSnapshot(Snap);
+    LastGroupCount = 0;
 }
 
-void FreeNodes(TreeNode * x) {
-    // For every tree node (state)
-    if (x != TM->nil) {
-        // Create temporary right tree ptr
-        TreeNode * RightTree = x->right;
+// Takes a snapshot of current tape as a delta of LiveBase, that shares the rest of the tape with its siblings.
+// Chains are cut with a full snapshot every SNAPSHOTCHAIN deltas, to bound the time to rebuild a tape
+Snapshot * CaptureDelta(long Head) {
+    Snapshot * Snap;
 
-        // Free left tree
-        FreeNodes(x->left);
+    if (LiveBase != NULL && LiveBase->Depth + 1 >= SNAPSHOTCHAIN) {
+        Snap = CaptureSnapshot(__INT_MAX__, MemoryTape.Min, MemoryTape.Max, Head);
+    } else {
+        // With no LiveBase the rest of the tape is blank, so the window alone is a full snapshot
+        if (DirtyMin > DirtyMax) {
+            Snap = CaptureSnapshot(__INT_MAX__, Head, Head - 1, Head);
+        } else {
+            Snap = CaptureSnapshot(__INT_MAX__, DirtyMin, DirtyMax, Head);
+        }
+        if (LiveBase != NULL) {
+            Snap->Parent = LiveBase;
+            Snap->Depth = LiveBase->Depth + 1;
+            LiveBase->RefCount++;
+        }
+    }
 
-        // Free this node
-        free(x->StatePtr);
-        free(x);
+    // Current tape is now the new snapshot
+    ReleaseSnapshot(LiveBase);
+    LiveBase = Snap;
+    LiveBase->RefCount++;
+    DirtyMin = __LONG_MAX__;
+    DirtyMax = -__LONG_MAX__ - 1;
 
-        // Free right tree through temp ptr
-        FreeNodes(RightTree);
+    return Snap;
+}
+
+// Computes GoalDistance of every state with a breadth first visit of reversed state graph from acceptance states
+void ComputeGoalDistances() {
+    uint32_t * InCount = calloc(StateCount + 1, sizeof(uint32_t));
+    uint32_t * InEdges, * Queue, Head = 0, Tail = 0, s, t;
+
+    for (s = 0; s < StateCount; s++) {
+        State * CurrState = States[s];
+
+        for (t = CurrState->FirstTransition[0]; t < CurrState->FirstTransition[CurrState->KeyCount]; t++) {
+            InCount[Packed[t].ToState + 1]++;
+        }
+    }
+    for (s = 0; s < StateCount; s++) {
+        InCount[s + 1] += InCount[s];
+    }
+
+    InEdges = malloc(sizeof(uint32_t) * (InCount[StateCount] > 0 ? InCount[StateCount] : 1));
+    Queue = malloc(sizeof(uint32_t) * (StateCount > 0 ? StateCount : 1));
+
+    // InCount[q] is used as fill cursor of predecessors of q, then restored
+    for (s = 0; s < StateCount; s++) {
+        State * CurrState = States[s];
+
+        for (t = CurrState->FirstTransition[0]; t < CurrState->FirstTransition[CurrState->KeyCount]; t++) {
+            InEdges[InCount[Packed[t].ToState]++] = s;
+        }
     }
-}
\ No newline at end of file
+    for (s = StateCount; s > 0; s--) {
+        InCount[s] = InCount[s - 1];
+    }
+    InCount[0] = 0;
+
+    for (s = 0; s < StateCount; s++) {
+        States[s]->GoalDistance = NOACCEPT;
+        if (States[s]->IsAcceptanceState == true) {
+            States[s]->GoalDistance = 0;
+            Queue[Tail++] = s;
+        }
+    }
+
+    while (Head < Tail) {
+        uint32_t q = Queue[Head++];
+
+        for (t = InCount[q]; t < InCount[q + 1]; t++) {
+            if (States[InEdges[t]]->GoalDistance == NOACCEPT) {
+                States[InEdges[t]]->GoalDistance = States[q]->GoalDistance + 1;
+                Queue[Tail++] = InEdges[t];
+            }
+        }
+    }
+
+    free(InCount);
+    free(InEdges);
+    free(Queue);
+}
+
+// Min GoalDistance of states [Set] (NOACCEPT if none can reach acceptance)
+uint32_t SetGoalDistance(const uint64_t * Set) {
+    uint32_t Distance = NOACCEPT;
+    unsigned int w;
+
+    for (w = 0; w < SetWords; w++) {
+        uint64_t Bits = Set[w];
+
+        for (; Bits != 0; Bits &= Bits - 1) {
+            State * Target = States[w * 64 + (uint32_t) __builtin_ctzll(Bits)];
+
+            if (Target->GoalDistance < Distance) {
+                Distance = Target->GoalDistance;
+            }
+        }
+    }
+
+    return Distance;
+}
+
+// True if a branch to states [Set], with [MovesLeft] moves before its move, can't change the result anymore:
+// it can't reach acceptance before moves are over, and moves are already over on some other branch, so
+// that it would end in 0 or U but the result is U anyway. Before that, it must run to tell 0 from U
+bool IsHopeless(const uint64_t * Set, unsigned long int MovesLeft, int AreMovesOver) {
+    return AreMovesOver == 2 && (unsigned long int) SetGoalDistance(Set) + 1 >= MovesLeft;
+}
+
+// Sets up profile counters of packed machine
+void ProfileCreate() {
+    uint32_t Total = 0, s;
+
+    for (s = 0; s < StateCount; s++) {
+        if (States[s]->FirstTransition[States[s]->KeyCount] > Total) {
+            Total = States[s]->FirstTransition[States[s]->KeyCount];
+        }
+    }
+
+    TransitionHits = calloc(Total + 1, sizeof(uint64_t));
+    StateBacktracks = calloc(StateCount + 1, sizeof(uint64_t));
+}
+
+// Counts a backtrack into every state of [Set]
+void ProfileBacktrack(const uint64_t * Set) {
+    unsigned int w;
+
+    for (w = 0; w < SetWords; w++) {
+        uint64_t Bits = Set[w];
+
+        for (; Bits != 0; Bits &= Bits - 1) {
+            StateBacktracks[w * 64 + (uint32_t) __builtin_ctzll(Bits)]++;
+        }
+    }
+}
+
+// Writes profile as a DOT graph, [ProfilePath].dot, with states colored from cold (blue) to hot (red) by the
+// moves made from them and edges as thick as the times their transition ran, and as folded stacks for flame
+// graph tools, [ProfilePath].folded, one "state;transition count" line per transition that ran and one
+// "state;backtrack count" line per state backtracked into
+void ProfileWrite() {
+    char Path[4096], Read[8], Write[8];
+    uint64_t * StateHits = calloc(StateCount + 1, sizeof(uint64_t)), MaxState = 1, MaxTransition = 1;
+    FILE * Dot, * Folded;
+    uint32_t s, k, t;
+
+    for (s = 0; s < StateCount; s++) {
+        for (t = States[s]->FirstTransition[0]; t < States[s]->FirstTransition[States[s]->KeyCount]; t++) {
+            StateHits[s] += TransitionHits[t];
+            MaxTransition = (TransitionHits[t] > MaxTransition) ? TransitionHits[t] : MaxTransition;
+        }
+        MaxState = (StateHits[s] > MaxState) ? StateHits[s] : MaxState;
+    }
+
+    snprintf(Path, sizeof(Path), "%s.dot", ProfilePath);
+    Dot = fopen(Path, "w");
+    snprintf(Path, sizeof(Path), "%s.folded", ProfilePath);
+    Folded = fopen(Path, "w");
+    if (Dot == NULL || Folded == NULL) {
+        fprintf(stderr, "ERROR: Cannot write profile files %s.dot and %s.folded\n", ProfilePath, ProfilePath);
+        if (Dot != NULL) {
+            fclose(Dot);
+        }
+        if (Folded != NULL) {
+            fclose(Folded);
+        }
+        free(StateHits);
+        return;
+    }
+
+    fprintf(Dot, "digraph Profile {\n    node [style=filled];\n");
+    for (s = 0; s < StateCount; s++) {
+        fprintf(Dot, "    q%u [shape=%s, fillcolor=\"%.3f 0.6 1.0\", label=\"%u\\n%llu moves\\n%llu backtracks\"];\n", States[s]->id,
+                States[s]->IsAcceptanceState == true ? "doublecircle" : "circle", 0.66 * (1.0 - (double) StateHits[s] / (double) MaxState),
+                States[s]->id, (unsigned long long) StateHits[s], (unsigned long long) StateBacktracks[s]);
+        if (StateBacktracks[s] > 0) {
+            fprintf(Folded, "q%u;backtrack %llu\n", States[s]->id, (unsigned long long) StateBacktracks[s]);
+        }
+
+        for (k = 0; k < States[s]->KeyCount; k++) {
+            ProfileSymbol(States[s]->Keys[k], Read);
+
+            for (t = States[s]->FirstTransition[k]; t < States[s]->FirstTransition[k + 1]; t++) {
+                ProfileSymbol(Packed[t].Write, Write);
+                fprintf(Dot, "    q%u -> q%u [label=\"%s/%s,%c %llu\", penwidth=%.2f%s];\n", States[s]->id, States[Packed[t].ToState]->id,
+                        Read, Write, MoveDirections[Packed[t].Move], (unsigned long long) TransitionHits[t],
+                        1.0 + 7.0 * (double) TransitionHits[t] / (double) MaxTransition, TransitionHits[t] == 0 ? ", style=dotted" : "");
+                if (TransitionHits[t] > 0) {
+                    fprintf(Folded, "q%u;%s/%s %c q%u %llu\n", States[s]->id, Read, Write, MoveDirections[Packed[t].Move],
+                            States[Packed[t].ToState]->id, (unsigned long long) TransitionHits[t]);
+                }
+            }
+        }
+    }
+    fprintf(Dot, "}\n");
+
+    fclose(Dot);
+    fclose(Folded);
+    free(StateHits);
+}
+
+// Printable form of [Symbol] for profile files: symbols that would break DOT labels or folded frames, and
+// track codes, are written as hex escapes
+void ProfileSymbol(char Symbol, char * Out) {
+    unsigned char Code = (unsigned char) Symbol;
+
+    if (Code > ' ' && Code < 127 && Code != '"' && Code != '\\' && Code != ';') {
+        Out[0] = Symbol;
+        Out[1] = '\0';
+    } else {
+        snprintf(Out, 8, "x%02x", Code);
+    }
+}
+
+// Reads a "state priority" pair per line. States not in file keep priority 0
+void LoadPriorities(const char * Path) {
+    FILE * File = fopen(Path, "r");
+    unsigned int Id;
+    long Priority;
+
+    if (File == NULL) {
+        fprintf(stderr, "WARNING: Cannot open priority file %s\n", Path);
+        return;
+    }
+
+    while (fscanf(File, "%u %ld", &Id, &Priority) == 2) {
+        TreeNode * Node = SearchNode(TM, TM->root, Id);
+
+        if (Node != NULL && Node != TM->nil) {
+            Node->StatePtr->Priority = Priority;
+        }
+    }
+
+    fclose(File);
+}
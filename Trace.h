@@ -0,0 +1,87 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Binary execution trace, written by the simulator with -r and read by TraceTool.
+// A trace is a TraceHeader, the TraceTransitions of the machine and a stream of variable length records: for
+// every input tape a tape record, the moves of its simulation and a result record.
+// Every record starts with a tag, a varint holding the TraceKind in its low bits and flags above them. Every flag
+// has a bit of its own, the frequent ones in the first byte of the tag.
+// Numbers are LEB128 varints, signed ones zigzag encoded first. Records are numbered as if every move had one,
+// so a run record of n moves takes n numbers. Head positions are never stored: a move starts where its parent
+// left the head (cell 0 if it has none)
+//   Tape:   tag, tape nr., tape length, tape symbols, then if TRACEMACHINE the nr. of machine transitions and the
+//           TraceTransitions that replace the ones before from this tape on (a multi-track machine whose wildcards
+//           were expanded again for new input symbols)
+//   Run:    tag, nr. of moves. Moves of the deterministic engine from the tape start, each the parent of the next.
+//           They are found again by running the machine transitions on the tape. If TRACECONTINUED, moves of the
+//           branching engine: replayed moves that pushed every branch (see below), or, if the trace isn't
+//           replayed, moves continuing the record before on its branch, from the single state it reached, whose
+//           only transition for the read symbol is every time the next move
+//   Step:   tag (move direction in TRACEMOVE bits), read symbol, written symbol, id of reached state (lowest one
+//           if the move reached a set of states), then record nr. distance to parent (0 if none) if TRACEPARENT,
+//           nr. of reached states if TRACESTATES, branch of branching engine if TRACEBRANCH. Otherwise the parent
+//           is the record before, a single state is reached and the branch is the one of the step before
+//   Result: tag, simulation result (0, 1, 2 for U, 3 for T), then parent as for steps, then nr. of moves of the
+//           tape, that TraceTool checks against the moves it decoded
+// If the header has TRACEREPLAYED (lifo scheduler), the branching engine writes no step records: TraceTool keeps
+// its stack of branches and finds every move again from the machine transitions. Its records are instead replayed
+// steps, with TRACEREPLAY in place of the move direction:
+//   tag, then if TRACEPUSHED the nr. of pushed branches and the slot of each. A slot is a tape effect (write and
+//   move) of the states of the move for the symbol they read, in order of first use going through the states by
+//   id and their transitions by written symbol and direction; its branch is never pushed if it has no state.
+//   Without TRACEPUSHED every slot with a state was pushed.
+//   A replayed move takes the branch on top of the stack (TRACEPAGED if it was paged in from disk: branch 0),
+//   then pushes its slots. If TRACEDROPPED the branch on top is dropped without moving instead, if TRACEEXPAND
+//   the slots of state 0 are pushed, with its self loops, before any move (if TRACERESUMED those of the state
+//   reached by the record before, without self loops)
+
+#define TRACEMAGIC 0x52544D54       // "TMTR"
+#define TRACEVERSION 5
+#define TRACENOPARENT UINT64_MAX
+
+#define TRACEKIND 0x03
+#define TRACEMOVE 0x0C              // Direction of a step (0 L, 1 R, 2 S), shifted by TRACEMOVESHIFT
+#define TRACEMOVESHIFT 2
+#define TRACEREPLAY 0x0C            // Replayed step of the branching engine, in TRACEMOVE bits
+#define TRACEPARENT 0x10            // Step or result whose parent isn't the record before
+#define TRACEBRANCH 0x20            // Step on a branch other than the one of the step before
+#define TRACEDROPPED 0x40           // Replayed step dropping a branch
+#define TRACECONTINUED 0x80         // Run record continuing the record before
+#define TRACEPUSHED 0x100           // Replayed step that didn't push every slot
+#define TRACESTATES 0x200           // Step reaching more than one state
+#define TRACEMACHINE 0x400          // Tape record followed by new machine transitions
+#define TRACEPAGED 0x800            // Replayed move of a branch paged in from disk
+#define TRACEEXPAND 0x1000          // Replayed pushes of the first state
+#define TRACERESUMED 0x2000         // Replayed pushes of the first state after the deterministic engine
+#define TRACEREPLAYED 0x01          // Header flag: moves of branching engine are replayed steps
+#define TRACEMAXRECORD 48           // Max bytes of a record, tape symbols and pushed slots apart
+
+typedef enum {
+    TraceTape,
+    TraceStep,
+    TraceResult,
+    TraceRun
+} TraceKind;
+
+// Definition of trace file header
+typedef struct {
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t Fingerprint;           // Fingerprint of traced machine
+    uint32_t TransitionCount;       // Nr. of TraceTransitions after the header
+    uint32_t Flags;                 // TRACEREPLAYED if moves of branching engine are replayed
+} TraceHeader;
+
+// Definition of a machine transition, as run records are replayed
+typedef struct {
+    uint32_t From;                  // Id of start state
+    uint32_t To;                    // Id of end state
+    char Read;
+    char Write;
+    uint8_t Move;                   // 0 L, 1 R, 2 S
+    uint8_t Reserved;
+} TraceTransition;
+
+#endif
@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "Trace.h"
+
+// Reads traces written by the simulator with -r.
+//   TraceTool show TRACE      prints, for every tape, the accepting branch (or the longest one if none accepted)
+//   TraceTool diff TRACEA TRACEB  prints the first move where two traces diverge
+
+typedef enum {false, true} bool;
+
+// Definition of a decoded trace record
+typedef struct {
+    uint8_t Kind;                   // TraceKind, run records are decoded into their steps
+    char Read;                      // Symbol under head before the move
+    char Write;                     // Symbol written by the move
+    uint8_t Move;                   // Direction where head moved (0 L, 1 R, 2 S)
+    int32_t BranchID;               // Branch of branching engine (0 on deterministic engine)
+    uint32_t State;                 // Id of reached state, or simulation result
+    uint32_t StateCount;            // Nr. of states reached by the move
+    int64_t Head;                   // Head position after the move, or tape length
+    uint64_t Parent;                // Record nr. of the move before this one (TRACENOPARENT if first move), or tape nr.
+} TraceRecord;
+
+// Definition of a loaded trace
+typedef struct {
+    TraceHeader Header;
+    TraceTransition * Transitions;  // Sorted by start state and read symbol
+    TraceRecord * Records;
+    uint64_t Count;
+    uint64_t Capacity;
+} Trace;
+
+// Definition of a branch of the branching engine, as its stack is replayed
+typedef struct {
+    uint64_t Parent;                // Record nr. of the move that pushed it (TRACENOPARENT if none)
+    char Write;                     // Symbol its move writes
+    uint8_t Move;                   // Direction of its move
+    int32_t BranchID;
+} ReplayBranch;
+
+// Definition of what's known of a trace while it's decoded
+typedef struct {
+    const char * Tape;              // Symbols of current tape
+    uint64_t TapeLength;
+    uint64_t TapeRecord;            // Record nr. of current tape
+    int32_t Branch;                 // Branch of the last step, current branch of branching engine if replayed
+    char * Cells;                   // Tape left by record At, grown as needed
+    size_t CellCount;
+    int64_t Origin;                 // Index in Cells of tape position 0
+    uint64_t At;                    // Record whose tape Cells hold (TRACENOPARENT for the tape start)
+    uint64_t * Path;                // Records whose moves MoveTape does again
+    size_t PathCapacity;
+    ReplayBranch * Stack;           // Replayed stack of branching engine
+    uint64_t * Sets;                // States of every branch of Stack (SetWords words each)
+    size_t StackSize;
+    size_t StackCapacity;
+    uint32_t * StateIds;            // Ids of machine states, sorted: a state is numbered by its position
+    uint32_t StateCount;
+    uint32_t SetWords;
+    uint64_t * Popped;              // States of the branch last popped
+    uint64_t * SlotSets;            // States of every slot found by FindSlots
+    char * SlotWrite;
+    uint8_t * SlotMove;
+    uint32_t SlotCapacity;
+} TraceDecoder;
+
+// Definition of the encoded records of a trace, while they are decoded
+typedef struct {
+    const unsigned char * Bytes;
+    size_t Size;
+    size_t Position;
+} TraceReader;
+
+const char MoveDirections[] = {'L', 'R', 'S'};
+
+const char ResultSymbols[] = {'0', '1', 'U', 'T'};
+
+bool LoadTrace(const char * Path, Trace * T);
+
+bool DecodeRecords(Trace * T, TraceReader * Reader);
+
+bool DecodeRecord(Trace * T, TraceReader * Reader, TraceDecoder * D);
+
+bool ReplayStep(Trace * T, TraceReader * Reader, TraceDecoder * D, uint64_t Tag);
+
+bool ReplayMove(Trace * T, TraceDecoder * D, bool Paged, const uint32_t * Pushed, uint64_t Count);
+
+bool PushSlots(Trace * T, TraceDecoder * D, uint64_t Parent, bool SkipLoops, const uint32_t * Pushed, uint64_t Count);
+
+uint32_t FindSlots(const Trace * T, TraceDecoder * D, char Read, bool SkipLoops);
+
+bool AddState(const TraceDecoder * D, uint64_t * Set, uint32_t Id);
+
+bool SetIsEmpty(const TraceDecoder * D, const uint64_t * Set);
+
+void IndexStates(const Trace * T, TraceDecoder * D);
+
+int CompareIds(const void * a, const void * b);
+
+void MoveTape(const Trace * T, TraceDecoder * D, uint64_t Target);
+
+char * TapeCell(TraceDecoder * D, int64_t Position);
+
+bool GetNumber(TraceReader * Reader, uint64_t * Number);
+
+TraceRecord * AddRecord(Trace * T);
+
+bool ReplaceTransitions(Trace * T, TraceReader * Reader, TraceDecoder * D);
+
+bool ReplayRun(Trace * T, TraceDecoder * D, uint64_t Parent, uint64_t Count);
+
+uint32_t FirstTransition(const Trace * T, uint32_t From, char Read);
+
+int CompareTransitions(const void * a, const void * b);
+
+void FreeTrace(Trace * T);
+
+uint64_t NextTape(const Trace * T, uint64_t From);
+
+void ShowTrace(const Trace * T);
+
+void ShowBranch(const Trace * T, uint64_t Last);
+
+int DiffTraces(const Trace * A, const Trace * B);
+
+bool SameMove(const TraceRecord * a, const TraceRecord * b);
+
+void PrintMove(const char * Prefix, const TraceRecord * Record, uint64_t Depth);
+
+char ResultSymbol(uint32_t Result);
+
+int main(int argc, char ** argv) {
+    Trace A, B;
+    int Result;
+
+    if (argc == 3 && strcmp(argv[1], "show") == 0) {
+        if (LoadTrace(argv[2], &A) == false) {
+            return 2;
+        }
+        ShowTrace(&A);
+        FreeTrace(&A);
+        return 0;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "diff") == 0) {
+        if (LoadTrace(argv[2], &A) == false) {
+            return 2;
+        }
+        if (LoadTrace(argv[3], &B) == false) {
+            FreeTrace(&A);
+            return 2;
+        }
+        Result = DiffTraces(&A, &B);
+        FreeTrace(&A);
+        FreeTrace(&B);
+        return Result;
+    }
+
+    fprintf(stderr, "Usage: %s show trace | %s diff tracea traceb\n", argv[0], argv[0]);
+    return 2;
+}
+
+bool LoadTrace(const char * Path, Trace * T) {
+    FILE * File = fopen(Path, "rb");
+    TraceReader Reader;
+    unsigned char * Bytes;
+    size_t Transitions;
+    long Size;
+    bool Loaded;
+
+    if (File == NULL) {
+        fprintf(stderr, "ERROR: Cannot open trace file %s\n", Path);
+        return false;
+    }
+
+    if (fread(&T->Header, sizeof(T->Header), 1, File) != 1 || T->Header.Magic != TRACEMAGIC || T->Header.Version != TRACEVERSION) {
+        fprintf(stderr, "ERROR: %s is not a trace file\n", Path);
+        fclose(File);
+        return false;
+    }
+
+    fseek(File, 0, SEEK_END);
+    Size = ftell(File) - (long) sizeof(T->Header);
+    fseek(File, (long) sizeof(T->Header), SEEK_SET);
+
+    Transitions = sizeof(TraceTransition) * T->Header.TransitionCount;
+    Bytes = malloc(Size > 0 ? (size_t) Size : 1);
+    if (Size < (long) Transitions || fread(Bytes, 1, (size_t) Size, File) != (size_t) Size) {
+        fprintf(stderr, "ERROR: Truncated trace file %s\n", Path);
+        free(Bytes);
+        fclose(File);
+        return false;
+    }
+    fclose(File);
+
+    T->Transitions = malloc(Transitions > 0 ? Transitions : 1);
+    memcpy(T->Transitions, Bytes, Transitions);
+    qsort(T->Transitions, T->Header.TransitionCount, sizeof(TraceTransition), CompareTransitions);
+
+    T->Records = NULL;
+    T->Count = 0;
+    T->Capacity = 0;
+    Reader.Bytes = Bytes + Transitions;
+    Reader.Size = (size_t) Size - Transitions;
+    Reader.Position = 0;
+
+    // A trace cut short, as by a killed simulation, is shown up to its last whole record
+    Loaded = DecodeRecords(T, &Reader);
+    free(Bytes);
+    if (Loaded == false) {
+        fprintf(stderr, "WARNING: Trace file %s is truncated or corrupted after record %llu\n", Path, (unsigned long long) T->Count);
+    }
+    return true;
+}
+
+// Decodes every record of [Reader] in T->Records, with run records and replayed steps turned into their moves.
+// Returns false if a record can't be decoded, keeping the ones before it
+bool DecodeRecords(Trace * T, TraceReader * Reader) {
+    TraceDecoder D;
+    bool Decoded = true;
+
+    memset(&D, 0, sizeof(D));
+    D.At = TRACENOPARENT;
+    IndexStates(T, &D);
+
+    while (Reader->Position < Reader->Size) {
+        uint64_t Count = T->Count;
+
+        if (DecodeRecord(T, Reader, &D) == false) {
+            T->Count = Count;
+            Decoded = false;
+            break;
+        }
+    }
+
+    free(D.Cells);
+    free(D.Path);
+    free(D.Stack);
+    free(D.Sets);
+    free(D.StateIds);
+    free(D.Popped);
+    free(D.SlotSets);
+    free(D.SlotWrite);
+    free(D.SlotMove);
+    return Decoded;
+}
+
+// Decodes next record of [Reader], updating decoder [D]
+bool DecodeRecord(Trace * T, TraceReader * Reader, TraceDecoder * D) {
+    TraceRecord * Record;
+    uint64_t Tag, Number, i;
+    uint8_t Kind;
+
+    if (GetNumber(Reader, &Tag) == false) {
+        return false;
+    }
+    Kind = Tag & TRACEKIND;
+
+    if (Kind == TraceRun) {
+        if (GetNumber(Reader, &Number) == false || D->Tape == NULL) {
+            return false;
+        }
+        if ((Tag & TRACECONTINUED) == 0) {
+            D->Branch = 0;
+            return ReplayRun(T, D, TRACENOPARENT, Number);
+        }
+        if ((T->Header.Flags & TRACEREPLAYED) == 0) {
+            return T->Count > 0 && T->Records[T->Count - 1].Kind == TraceStep && T->Records[T->Count - 1].StateCount == 1 &&
+                ReplayRun(T, D, T->Count - 1, Number) == true;
+        }
+        for (i = 0; i < Number; i++) {
+            if (ReplayMove(T, D, false, NULL, 0) == false) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (Kind == TraceStep && (Tag & TRACEMOVE) == TRACEREPLAY) {
+        return (T->Header.Flags & TRACEREPLAYED) != 0 && D->Tape != NULL && ReplayStep(T, Reader, D, Tag) == true;
+    }
+
+    Record = AddRecord(T);
+    memset(Record, 0, sizeof(TraceRecord));
+    Record->Kind = Kind;
+
+    if (Kind == TraceTape) {
+        if (GetNumber(Reader, &Record->Parent) == false || GetNumber(Reader, &D->TapeLength) == false ||
+            D->TapeLength > Reader->Size - Reader->Position) {
+            return false;
+        }
+        Record->Head = (int64_t) D->TapeLength;
+        D->Tape = (const char *) Reader->Bytes + Reader->Position;
+        Reader->Position += D->TapeLength;
+        D->TapeRecord = T->Count - 1;
+        D->Branch = 0;
+        D->StackSize = 0;
+        if ((Tag & TRACEMACHINE) != 0 && ReplaceTransitions(T, Reader, D) == false) {
+            return false;
+        }
+
+        // Tape of the decoder is the one of the tape start, until a move changes it
+        free(D->Cells);
+        D->CellCount = (size_t) D->TapeLength + 1;
+        D->Cells = malloc(D->CellCount);
+        D->Cells[D->TapeLength] = '_';
+        memcpy(D->Cells, D->Tape, (size_t) D->TapeLength);
+        D->Origin = 0;
+        D->At = TRACENOPARENT;
+        return true;
+    }
+
+    if (Kind == TraceStep) {
+        if (Reader->Size - Reader->Position < 2) {
+            return false;
+        }
+        Record->Move = (uint8_t) ((Tag & TRACEMOVE) >> TRACEMOVESHIFT);
+        Record->Read = (char) Reader->Bytes[Reader->Position++];
+        Record->Write = (char) Reader->Bytes[Reader->Position++];
+    }
+    if (GetNumber(Reader, &Number) == false) {
+        return false;
+    }
+    Record->State = (uint32_t) Number;
+
+    // Parent is the record before, unless flags tell otherwise
+    Record->Parent = T->Count - 2;
+    if ((Tag & TRACEPARENT) != 0) {
+        if (GetNumber(Reader, &Number) == false || Number > T->Count - 1) {
+            return false;
+        }
+        Record->Parent = (Number == 0) ? TRACENOPARENT : T->Count - 1 - Number;
+    }
+    if (Record->Parent != TRACENOPARENT && (Record->Parent >= T->Count - 1 || T->Records[Record->Parent].Kind != TraceStep)) {
+        return false;
+    }
+
+    // Moves decoded since the tape record must be the ones the simulator made
+    if (Kind == TraceResult) {
+        return GetNumber(Reader, &Number) == true && D->Tape != NULL && Number == T->Count - D->TapeRecord - 2;
+    }
+
+    Record->StateCount = 1;
+    if ((Tag & TRACESTATES) != 0) {
+        if (GetNumber(Reader, &Number) == false) {
+            return false;
+        }
+        Record->StateCount = (uint32_t) Number;
+    }
+    if ((Tag & TRACEBRANCH) != 0) {
+        if (GetNumber(Reader, &Number) == false) {
+            return false;
+        }
+        D->Branch = (int32_t) ((Number >> 1) ^ -(Number & 1));
+    }
+    Record->BranchID = D->Branch;
+    Record->Head = (Record->Parent == TRACENOPARENT) ? 0 : T->Records[Record->Parent].Head;
+    Record->Head += (Record->Move == 0) ? -1 : (Record->Move == 1) ? 1 : 0;
+
+    return true;
+}
+
+// Decodes the replayed step with [Tag]: a dropped branch, the pushes of the first state or a move
+bool ReplayStep(Trace * T, TraceReader * Reader, TraceDecoder * D, uint64_t Tag) {
+    uint64_t Count = 0, Number, Parent = TRACENOPARENT, i;
+    uint32_t * Pushed = NULL, First = 0;
+    bool Replayed;
+
+    if ((Tag & TRACEDROPPED) != 0) {
+        if (D->StackSize == 0) {
+            return false;
+        }
+        D->StackSize--;
+        return true;
+    }
+
+    if ((Tag & TRACEPUSHED) != 0) {
+        if (GetNumber(Reader, &Count) == false || Count > Reader->Size - Reader->Position) {
+            return false;
+        }
+        Pushed = malloc(sizeof(uint32_t) * (Count > 0 ? Count : 1));
+        for (i = 0; i < Count; i++) {
+            if (GetNumber(Reader, &Number) == false || Number > UINT32_MAX) {
+                free(Pushed);
+                return false;
+            }
+            Pushed[i] = (uint32_t) Number;
+        }
+    }
+
+    if ((Tag & TRACEEXPAND) == 0) {
+        Replayed = ReplayMove(T, D, (Tag & TRACEPAGED) != 0, Pushed, Count);
+        free(Pushed);
+        return Replayed;
+    }
+
+    // After the deterministic engine, pushes are of the state its last move reached
+    if ((Tag & TRACERESUMED) != 0 && T->Count > 0 && T->Records[T->Count - 1].Kind == TraceStep) {
+        Parent = T->Count - 1;
+        First = T->Records[Parent].State;
+    }
+    memset(D->Popped, 0, sizeof(uint64_t) * D->SetWords);
+    Replayed = AddState(D, D->Popped, First) == true && PushSlots(T, D, Parent, (Tag & TRACERESUMED) != 0, Pushed, Count) == true;
+    free(Pushed);
+    return Replayed;
+}
+
+// Adds the move of the branch on top of the replayed stack, then pushes its slots: [Count] [Pushed] ones, or every
+// one with a state if [Pushed] is NULL. A [Paged] branch was paged in from disk, so it's on branch 0
+bool ReplayMove(Trace * T, TraceDecoder * D, bool Paged, const uint32_t * Pushed, uint64_t Count) {
+    ReplayBranch Branch;
+    TraceRecord * Record;
+    int64_t Head;
+    uint32_t w, Lowest = UINT32_MAX, States = 0;
+
+    if (D->StackSize == 0) {
+        return false;
+    }
+    Branch = D->Stack[--D->StackSize];
+    memcpy(D->Popped, D->Sets + D->StackSize * D->SetWords, sizeof(uint64_t) * D->SetWords);
+
+    if (Paged == true) {
+        D->Branch = 0;
+    } else if (Branch.BranchID <= D->Branch) {
+        D->Branch = Branch.BranchID;
+    }
+
+    for (w = 0; w < D->SetWords; w++) {
+        if (D->Popped[w] != 0 && Lowest == UINT32_MAX) {
+            Lowest = w * 64 + (uint32_t) __builtin_ctzll(D->Popped[w]);
+        }
+        States += (uint32_t) __builtin_popcountll(D->Popped[w]);
+    }
+    if (Lowest == UINT32_MAX) {
+        return false;
+    }
+
+    MoveTape(T, D, Branch.Parent);
+    Head = (Branch.Parent == TRACENOPARENT) ? 0 : T->Records[Branch.Parent].Head;
+
+    Record = AddRecord(T);
+    Record->Kind = TraceStep;
+    Record->Read = *TapeCell(D, Head);
+    Record->Write = Branch.Write;
+    Record->Move = Branch.Move;
+    Record->BranchID = D->Branch;
+    Record->State = D->StateIds[Lowest];
+    Record->StateCount = States;
+    Record->Head = Head + ((Branch.Move == 0) ? -1 : (Branch.Move == 1) ? 1 : 0);
+    Record->Parent = Branch.Parent;
+
+    *TapeCell(D, Head) = Branch.Write;
+    D->At = T->Count - 1;
+
+    return PushSlots(T, D, T->Count - 1, true, Pushed, Count);
+}
+
+// Pushes on the replayed stack the slots of states D->Popped, for the symbol under the head left by record
+// [Parent], as the branching engine does
+bool PushSlots(Trace * T, TraceDecoder * D, uint64_t Parent, bool SkipLoops, const uint32_t * Pushed, uint64_t Count) {
+    uint32_t SlotCount, Slot;
+    uint64_t i, Added = 0;
+    char Read;
+
+    MoveTape(T, D, Parent);
+    Read = *TapeCell(D, (Parent == TRACENOPARENT) ? 0 : T->Records[Parent].Head);
+    SlotCount = FindSlots(T, D, Read, SkipLoops);
+
+    // Children of a branch share a new branch id, that is given up if there's only one
+    D->Branch++;
+    for (i = 0; i < ((Pushed != NULL) ? Count : SlotCount); i++) {
+        Slot = (Pushed != NULL) ? Pushed[i] : (uint32_t) i;
+        if (Slot >= SlotCount) {
+            return false;
+        }
+        if (SetIsEmpty(D, D->SlotSets + Slot * D->SetWords) == true) {
+            if (Pushed != NULL) {
+                return false;
+            }
+            continue;
+        }
+
+        if (D->StackSize == D->StackCapacity) {
+            D->StackCapacity = (D->StackCapacity == 0) ? 1024 : D->StackCapacity * 2;
+            D->Stack = realloc(D->Stack, sizeof(ReplayBranch) * D->StackCapacity);
+            D->Sets = realloc(D->Sets, sizeof(uint64_t) * D->SetWords * D->StackCapacity);
+        }
+        D->Stack[D->StackSize].Parent = Parent;
+        D->Stack[D->StackSize].Write = D->SlotWrite[Slot];
+        D->Stack[D->StackSize].Move = D->SlotMove[Slot];
+        D->Stack[D->StackSize].BranchID = D->Branch;
+        memcpy(D->Sets + D->StackSize * D->SetWords, D->SlotSets + Slot * D->SetWords, sizeof(uint64_t) * D->SetWords);
+        D->StackSize++;
+        Added++;
+    }
+    if (Added <= 1) {
+        D->Branch--;
+    }
+
+    return true;
+}
+
+// Finds the slots of states D->Popped for symbol [Read]: a slot for every tape effect, in order of first use, with
+// the states it leads to. Self loops that don't move the head are left out if [SkipLoops]. Returns their nr.
+uint32_t FindSlots(const Trace * T, TraceDecoder * D, char Read, bool SkipLoops) {
+    uint32_t SlotCount = 0, Slot, s, t;
+
+    for (s = 0; s < D->StateCount; s++) {
+        if ((D->Popped[s / 64] & (1ULL << (s % 64))) == 0) {
+            continue;
+        }
+
+        for (t = FirstTransition(T, D->StateIds[s], Read); t < T->Header.TransitionCount &&
+             T->Transitions[t].From == D->StateIds[s] && T->Transitions[t].Read == Read; t++) {
+            const TraceTransition * Next = &T->Transitions[t];
+
+            for (Slot = 0; Slot < SlotCount && (D->SlotWrite[Slot] != Next->Write || D->SlotMove[Slot] != Next->Move); Slot++);
+            if (Slot == SlotCount) {
+                if (SlotCount == D->SlotCapacity) {
+                    D->SlotCapacity = (D->SlotCapacity == 0) ? 16 : D->SlotCapacity * 2;
+                    D->SlotSets = realloc(D->SlotSets, sizeof(uint64_t) * D->SetWords * D->SlotCapacity);
+                    D->SlotWrite = realloc(D->SlotWrite, D->SlotCapacity);
+                    D->SlotMove = realloc(D->SlotMove, D->SlotCapacity);
+                }
+                D->SlotWrite[Slot] = Next->Write;
+                D->SlotMove[Slot] = Next->Move;
+                memset(D->SlotSets + Slot * D->SetWords, 0, sizeof(uint64_t) * D->SetWords);
+                SlotCount++;
+            }
+
+            if (SkipLoops == false || Next->Move != 2 || Next->Write != Read || Next->To != Next->From) {
+                AddState(D, D->SlotSets + Slot * D->SetWords, Next->To);
+            }
+        }
+    }
+
+    return SlotCount;
+}
+
+// Adds state with id [Id] to [Set]. False if the machine has no such state
+bool AddState(const TraceDecoder * D, uint64_t * Set, uint32_t Id) {
+    const uint32_t * Found = bsearch(&Id, D->StateIds, D->StateCount, sizeof(uint32_t), CompareIds);
+    uint32_t Index;
+
+    if (Found == NULL) {
+        return false;
+    }
+    Index = (uint32_t) (Found - D->StateIds);
+    Set[Index / 64] |= 1ULL << (Index % 64);
+    return true;
+}
+
+bool SetIsEmpty(const TraceDecoder * D, const uint64_t * Set) {
+    uint32_t w;
+
+    for (w = 0; w < D->SetWords; w++) {
+        if (Set[w] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Numbers the states of the machine by id, as the branching engine does
+void IndexStates(const Trace * T, TraceDecoder * D) {
+    uint32_t i, Count = 1;
+
+    free(D->StateIds);
+    D->StateIds = malloc(sizeof(uint32_t) * (2 * T->Header.TransitionCount + 1));
+    D->StateIds[0] = 0;
+    for (i = 0; i < T->Header.TransitionCount; i++) {
+        D->StateIds[Count++] = T->Transitions[i].From;
+        D->StateIds[Count++] = T->Transitions[i].To;
+    }
+    qsort(D->StateIds, Count, sizeof(uint32_t), CompareIds);
+
+    D->StateCount = 0;
+    for (i = 0; i < Count; i++) {
+        if (D->StateCount == 0 || D->StateIds[D->StateCount - 1] != D->StateIds[i]) {
+            D->StateIds[D->StateCount++] = D->StateIds[i];
+        }
+    }
+
+    D->SetWords = (D->StateCount + 63) / 64;
+    D->Popped = realloc(D->Popped, sizeof(uint64_t) * D->SetWords);
+    free(D->Sets);
+    free(D->SlotSets);
+    free(D->SlotWrite);
+    free(D->SlotMove);
+    D->Sets = NULL;
+    D->SlotSets = NULL;
+    D->SlotWrite = NULL;
+    D->SlotMove = NULL;
+    D->StackCapacity = 0;
+    D->SlotCapacity = 0;
+}
+
+int CompareIds(const void * a, const void * b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Brings the tape of decoder to the one left by record [Target] (tape start if TRACENOPARENT): moves from the
+// record it has now up to their common ancestor are undone, then the ones down to [Target] are done again
+void MoveTape(const Trace * T, TraceDecoder * D, uint64_t Target) {
+    uint64_t From = D->At, To = Target, Depth = 0;
+
+    // A parent always comes before its children, so the later of the two records can't be an ancestor of the other
+    while (From != To) {
+        if (To == TRACENOPARENT || (From != TRACENOPARENT && From > To)) {
+            const TraceRecord * Move = &T->Records[From];
+
+            *TapeCell(D, Move->Head - ((Move->Move == 0) ? -1 : (Move->Move == 1) ? 1 : 0)) = Move->Read;
+            From = Move->Parent;
+        } else {
+            if (Depth == D->PathCapacity) {
+                D->PathCapacity = (D->PathCapacity == 0) ? 1024 : D->PathCapacity * 2;
+                D->Path = realloc(D->Path, sizeof(uint64_t) * D->PathCapacity);
+            }
+            D->Path[Depth++] = To;
+            To = T->Records[To].Parent;
+        }
+    }
+
+    while (Depth > 0) {
+        const TraceRecord * Move = &T->Records[D->Path[--Depth]];
+
+        *TapeCell(D, Move->Head - ((Move->Move == 0) ? -1 : (Move->Move == 1) ? 1 : 0)) = Move->Write;
+    }
+    D->At = Target;
+}
+
+// Cell at [Position] of the tape of decoder, that grows with blank cells to reach it
+char * TapeCell(TraceDecoder * D, int64_t Position) {
+    int64_t Index = D->Origin + Position;
+
+    if (Index < 0 || Index >= (int64_t) D->CellCount) {
+        size_t Grow = D->CellCount + (size_t) ((Index < 0) ? -Index : Index - (int64_t) D->CellCount + 1);
+        char * Cells = malloc(D->CellCount + 2 * Grow);
+
+        memset(Cells, '_', D->CellCount + 2 * Grow);
+        memcpy(Cells + Grow, D->Cells, D->CellCount);
+        free(D->Cells);
+        D->Cells = Cells;
+        D->CellCount += 2 * Grow;
+        D->Origin += (int64_t) Grow;
+        Index += (int64_t) Grow;
+    }
+    return &D->Cells[Index];
+}
+
+// Reads an LEB128 number
+bool GetNumber(TraceReader * Reader, uint64_t * Number) {
+    unsigned int Shift = 0;
+
+    *Number = 0;
+    while (Reader->Position < Reader->Size && Shift < 64) {
+        uint8_t Byte = Reader->Bytes[Reader->Position++];
+
+        *Number |= (uint64_t) (Byte & 0x7F) << Shift;
+        if ((Byte & 0x80) == 0) {
+            return true;
+        }
+        Shift += 7;
+    }
+    return false;
+}
+
+TraceRecord * AddRecord(Trace * T) {
+    if (T->Count == T->Capacity) {
+        T->Capacity = (T->Capacity == 0) ? 1024 : T->Capacity * 2;
+        T->Records = realloc(T->Records, sizeof(TraceRecord) * T->Capacity);
+    }
+    return &T->Records[T->Count++];
+}
+
+// Reads the machine transitions that follow a tape record, in place of the ones before
+bool ReplaceTransitions(Trace * T, TraceReader * Reader, TraceDecoder * D) {
+    uint64_t Count;
+
+    if (GetNumber(Reader, &Count) == false || Count > (Reader->Size - Reader->Position) / sizeof(TraceTransition)) {
+        return false;
+    }
+
+    T->Transitions = realloc(T->Transitions, sizeof(TraceTransition) * (Count > 0 ? Count : 1));
+    memcpy(T->Transitions, Reader->Bytes + Reader->Position, sizeof(TraceTransition) * Count);
+    Reader->Position += sizeof(TraceTransition) * Count;
+    T->Header.TransitionCount = (uint32_t) Count;
+    qsort(T->Transitions, T->Header.TransitionCount, sizeof(TraceTransition), CompareTransitions);
+    IndexStates(T, D);
+
+    return true;
+}
+
+// Adds the [Count] moves of a run record, found again by running machine transitions from record [Parent] (from
+// state 0 on the tape start if TRACENOPARENT). Every state reached has a single transition for the read symbol,
+// as the deterministic engine only runs those, and so has every state of a continued run
+bool ReplayRun(Trace * T, TraceDecoder * D, uint64_t Parent, uint64_t Count) {
+    uint32_t CurrState = (Parent != TRACENOPARENT) ? T->Records[Parent].State : 0, t;
+    int64_t Head = (Parent != TRACENOPARENT) ? T->Records[Parent].Head : 0;
+    uint64_t i;
+
+    MoveTape(T, D, Parent);
+
+    for (i = 0; i < Count; i++) {
+        char * Cell = TapeCell(D, Head);
+        const TraceTransition * Next;
+        TraceRecord * Record;
+
+        t = FirstTransition(T, CurrState, *Cell);
+        if (t == T->Header.TransitionCount || T->Transitions[t].From != CurrState || T->Transitions[t].Read != *Cell) {
+            return false;
+        }
+        Next = &T->Transitions[t];
+
+        Record = AddRecord(T);
+        Record->Kind = TraceStep;
+        Record->Read = *Cell;
+        Record->Write = Next->Write;
+        Record->Move = Next->Move;
+        Record->BranchID = D->Branch;
+        Record->State = Next->To;
+        Record->StateCount = 1;
+
+        *Cell = Next->Write;
+        Head += (Next->Move == 0) ? -1 : (Next->Move == 1) ? 1 : 0;
+        Record->Head = Head;
+        Record->Parent = Parent;
+
+        Parent = T->Count - 1;
+        D->At = Parent;
+        CurrState = Next->To;
+    }
+
+    return true;
+}
+
+// Index of the first transition from state [From] for symbol [Read], or of the one after where it would be
+uint32_t FirstTransition(const Trace * T, uint32_t From, char Read) {
+    uint32_t Low = 0, High = T->Header.TransitionCount;
+
+    while (Low < High) {
+        uint32_t Middle = Low + (High - Low) / 2;
+        const TraceTransition * Next = &T->Transitions[Middle];
+
+        if (Next->From < From || (Next->From == From && (unsigned char) Next->Read < (unsigned char) Read)) {
+            Low = Middle + 1;
+        } else {
+            High = Middle;
+        }
+    }
+    return Low;
+}
+
+// Transitions of a state for a symbol are in the order the branching engine groups them: by written symbol,
+// direction and end state
+int CompareTransitions(const void * a, const void * b) {
+    const TraceTransition * x = a, * y = b;
+
+    if (x->From != y->From) {
+        return x->From < y->From ? -1 : 1;
+    }
+    if (x->Read != y->Read) {
+        return (unsigned char) x->Read - (unsigned char) y->Read;
+    }
+    if (x->Write != y->Write) {
+        return x->Write < y->Write ? -1 : 1;
+    }
+    if (x->Move != y->Move) {
+        return x->Move < y->Move ? -1 : 1;
+    }
+    return (x->To > y->To) - (x->To < y->To);
+}
+
+void FreeTrace(Trace * T) {
+    free(T->Transitions);
+    free(T->Records);
+}
+
+// Record nr. of first tape record at or after [From] (T->Count if none)
+uint64_t NextTape(const Trace * T, uint64_t From) {
+    while (From < T->Count && T->Records[From].Kind != TraceTape) {
+        From++;
+    }
+    return From;
+}
+
+void ShowTrace(const Trace * T) {
+    uint64_t Tape = NextTape(T, 0), i;
+
+    printf("Machine %016llx\n", (unsigned long long) T->Header.Fingerprint);
+
+    while (Tape < T->Count) {
+        uint64_t End = NextTape(T, Tape + 1), Moves = 0, Longest = TRACENOPARENT, LongestDepth = 0;
+        uint64_t * Depths = calloc(End - Tape, sizeof(uint64_t));
+        const TraceRecord * Result = NULL;
+
+        // Depth of every move, as parents always come before their children
+        for (i = Tape + 1; i < End; i++) {
+            const TraceRecord * Record = &T->Records[i];
+
+            if (Record->Kind == TraceResult) {
+                Result = Record;
+            } else if (Record->Kind == TraceStep) {
+                Moves++;
+                Depths[i - Tape] = (Record->Parent == TRACENOPARENT) ? 1 : Depths[Record->Parent - Tape] + 1;
+                if (Depths[i - Tape] > LongestDepth) {
+                    LongestDepth = Depths[i - Tape];
+                    Longest = i;
+                }
+            }
+        }
+        free(Depths);
+
+        printf("Tape %llu, length %lld: result %c, %llu moves\n", (unsigned long long) T->Records[Tape].Parent,
+               (long long) T->Records[Tape].Head, Result != NULL ? ResultSymbol(Result->State) : '?', (unsigned long long) Moves);
+
+        if (Result != NULL && Result->State == 1 && Result->Parent != TRACENOPARENT) {
+            printf("  Accepting branch:\n");
+            ShowBranch(T, Result->Parent);
+        } else if (Longest != TRACENOPARENT) {
+            printf("  Longest branch:\n");
+            ShowBranch(T, Longest);
+        }
+
+        Tape = End;
+    }
+}
+
+// Prints the moves from tape start to move [Last]
+void ShowBranch(const Trace * T, uint64_t Last) {
+    uint64_t Depth = 0, Record, i;
+    uint64_t * Path;
+
+    for (Record = Last; Record != TRACENOPARENT; Record = T->Records[Record].Parent) {
+        Depth++;
+    }
+
+    Path = malloc(sizeof(uint64_t) * Depth);
+    i = Depth;
+    for (Record = Last; Record != TRACENOPARENT; Record = T->Records[Record].Parent) {
+        Path[--i] = Record;
+    }
+
+    for (i = 0; i < Depth; i++) {
+        PrintMove("    ", &T->Records[Path[i]], i + 1);
+    }
+    free(Path);
+}
+
+// Compares traces tape by tape, in execution order. Returns 0 if they are the same, 1 otherwise
+int DiffTraces(const Trace * A, const Trace * B) {
+    uint64_t TapeA = NextTape(A, 0), TapeB = NextTape(B, 0);
+
+    if (A->Header.Fingerprint != B->Header.Fingerprint) {
+        printf("Traces come from different machines\n");
+    }
+
+    while (TapeA < A->Count && TapeB < B->Count) {
+        uint64_t EndA = NextTape(A, TapeA + 1), EndB = NextTape(B, TapeB + 1), Move = 0, i, j;
+        uint64_t TapeNr = A->Records[TapeA].Parent;
+
+        for (i = TapeA + 1, j = TapeB + 1; i < EndA && j < EndB; i++, j++) {
+            const TraceRecord * RecordA = &A->Records[i], * RecordB = &B->Records[j];
+
+            if (RecordA->Kind == TraceStep) {
+                Move++;
+            }
+            if (RecordA->Kind != RecordB->Kind || (RecordA->Kind == TraceStep && SameMove(RecordA, RecordB) == false)) {
+                printf("Tape %llu diverges at move %llu:\n", (unsigned long long) TapeNr, (unsigned long long) Move);
+                PrintMove("  < ", RecordA, Move);
+                PrintMove("  > ", RecordB, Move);
+                return 1;
+            }
+            if (RecordA->Kind == TraceResult && RecordA->State != RecordB->State) {
+                printf("Tape %llu results differ after %llu moves: %c, %c\n", (unsigned long long) TapeNr, (unsigned long long) Move,
+                       ResultSymbol(RecordA->State), ResultSymbol(RecordB->State));
+                return 1;
+            }
+        }
+
+        if (i < EndA || j < EndB) {
+            printf("Tape %llu: one trace stops after %llu moves\n", (unsigned long long) TapeNr, (unsigned long long) Move);
+            return 1;
+        }
+
+        TapeA = EndA;
+        TapeB = EndB;
+    }
+
+    if (TapeA < A->Count || TapeB < B->Count) {
+        printf("Traces have a different nr. of tapes\n");
+        return 1;
+    }
+
+    printf("Traces are the same\n");
+    return 0;
+}
+
+// Parents aren't compared: record nr. depends on what was traced before, and the execution order is compared already
+bool SameMove(const TraceRecord * a, const TraceRecord * b) {
+    return a->Read == b->Read && a->Write == b->Write && a->Move == b->Move && a->BranchID == b->BranchID &&
+           a->State == b->State && a->StateCount == b->StateCount && a->Head == b->Head;
+}
+
+void PrintMove(const char * Prefix, const TraceRecord * Record, uint64_t Depth) {
+    printf("%s%llu: read %c write %c move %c -> state %u", Prefix, (unsigned long long) Depth, Record->Read, Record->Write,
+           Record->Move < 3 ? MoveDirections[Record->Move] : '?', Record->State);
+    if (Record->StateCount > 1) {
+        printf(" (+%u)", Record->StateCount - 1);
+    }
+    printf(", head %lld, branch %d\n", (long long) Record->Head, Record->BranchID);
+}
+
+char ResultSymbol(uint32_t Result) {
+    return Result < 4 ? ResultSymbols[Result] : '?';
+}